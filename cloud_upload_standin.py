@@ -0,0 +1,75 @@
+# Local stand-in for the roller-results upload API, for testing the cloud upload without touching the real server.
+# Build the firmware with -DCLOUD_UPLOAD_URL=\"http://<this pc>:8080/\" and press "Upload now".
+# Every received trigger is printed and uploaded sessions are written to <out>/<sessionName>.json
+#
+# usage: python cloud_upload_standin.py [--port 8080] [--out uploads] [--fail-every N]
+
+import argparse
+import json
+import os
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+
+class UploadHandler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"  # keep-alive like the real server
+    sessions = {}
+    requests = 0
+
+    def do_POST(self):
+        UploadHandler.requests += 1
+        body = self.rfile.read(int(self.headers.get("Content-Length", 0)))
+        if self.server.fail_every and UploadHandler.requests % self.server.fail_every == 0:
+            print("request %i: injected failure" % UploadHandler.requests)
+            self.respond(500, "injected failure")
+            return
+        try:
+            upload = json.loads(body)
+        except ValueError as e:
+            print("request %i: invalid json: %s" % (UploadHandler.requests, e))
+            self.respond(400, "invalid json")
+            return
+        name = upload.get("sessionName")
+        if name is None:
+            name = str(len(UploadHandler.sessions) + 1)
+            UploadHandler.sessions[name] = {"user": upload.get("user"), "triggers": []}
+        elif name not in UploadHandler.sessions:
+            self.respond(404, "unknown session")
+            return
+        triggers = upload.get("triggers", [])
+        UploadHandler.sessions[name]["triggers"].extend(triggers)
+        print("request %i: session %s +%i triggers (%i total, %i bytes, keep-alive %s)" % (
+            UploadHandler.requests, name, len(triggers), len(UploadHandler.sessions[name]["triggers"]), len(body),
+            self.headers.get("Connection", "keep-alive")))
+        with open(os.path.join(self.server.out, name + ".json"), "w") as file:
+            json.dump(UploadHandler.sessions[name], file)
+        self.respond(200, name)
+
+    def respond(self, code, text):
+        data = text.encode()
+        self.send_response(code)
+        self.send_header("Content-Type", "text/plain")
+        self.send_header("Content-Length", str(len(data)))
+        self.end_headers()
+        self.wfile.write(data)
+
+    def log_message(self, format, *args):
+        pass
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Local stand-in for the cloud upload API")
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--out", default="uploads", help="directory for the received sessions")
+    parser.add_argument("--fail-every", type=int, default=0, help="answer every Nth request with 500 to test resuming")
+    args = parser.parse_args()
+
+    os.makedirs(args.out, exist_ok=True)
+    server = ThreadingHTTPServer(("", args.port), UploadHandler)
+    server.out = args.out
+    server.fail_every = args.fail_every
+    print("Listening on port %i" % args.port)
+    server.serve_forever()
+
+
+if __name__ == "__main__":
+    main()
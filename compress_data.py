@@ -0,0 +1,38 @@
+Import("env")
+
+# Builds the SPIFFS image from a copy of data/ in which text assets are gzipped.
+# The firmware serves "<file>.gz" with Content-Encoding: gzip to clients accepting gzip and the plain file otherwise.
+# Only the .gz is in the image, so clients without gzip get 406 for these files.
+
+import gzip
+import os
+import shutil
+
+GZIP_EXTENSIONS = (".html", ".css", ".js", ".json", ".svg", ".txt")
+
+SOURCE_DIR = env.subst("$PROJECT_DATA_DIR")
+TARGET_DIR = os.path.join(env.subst("$PROJECT_BUILD_DIR"), "data_gz")
+
+
+def compress_data():
+    if os.path.isdir(TARGET_DIR):
+        shutil.rmtree(TARGET_DIR)
+    os.makedirs(TARGET_DIR)
+    for name in os.listdir(SOURCE_DIR):
+        source = os.path.join(SOURCE_DIR, name)
+        if not os.path.isfile(source):
+            continue
+        if name.endswith(GZIP_EXTENSIONS):
+            target = os.path.join(TARGET_DIR, name + ".gz")
+            with open(source, "rb") as plain, open(target, "wb") as raw:
+                # mtime=0 keeps the output and therefore the ETag stable between builds
+                with gzip.GzipFile(filename="", mode="wb", fileobj=raw, compresslevel=9, mtime=0) as compressed:
+                    shutil.copyfileobj(plain, compressed)
+            print("gzip %s: %i -> %i bytes" % (name, os.path.getsize(source), os.path.getsize(target)))
+        else:
+            shutil.copy2(source, os.path.join(TARGET_DIR, name))
+
+
+if "buildfs" in COMMAND_LINE_TARGETS or "uploadfs" in COMMAND_LINE_TARGETS:
+    compress_data()
+    env.Replace(PROJECT_DATA_DIR=TARGET_DIR)
@@ -49,13 +49,14 @@ RotaryEncoder Rotary(&RotaryChanged, PIN_ROTARY_DT, PIN_ROTARY_CLK, PIN_ROTARY_S
 CRGB leds[NUM_LEDS_DISPLAY];
 LedMatrix matrix;
 
-volatile bool receivedFlag = false;
 // bool sendingFlag = false;
 uint64_t sendingUntilUs = 0;
+uint8_t radioNetwork = RADIO_NETWORK_JOIN;
 
 size_t loops = 0;
 timeMs_t lastHzMeasuredMs = 0;
 uint32_t loopHz = 0;
+uint32_t loopMaxUs = 0; // longest pass over the due tasks in the last second
 
 /**
  * Battery stuff
@@ -85,6 +86,7 @@ NumberField* distFromStartInput;
 NumberField* minDelayInput;
 NumberField* displayTimeInput;
 NumberField* displayBrightnessInput;
+NumberField* batteryLifeInput;
 Select* trainingsModeSelect;
 CheckBox* showAdvancedCB;
 SubMenu* debugSubMenu;
@@ -105,6 +107,10 @@ Select* fontSizeSelect;
 
 Button* uploadNowBtn;
 
+NumberField* radioNetworkInput;
+Button* findFreeNetworkBtn;
+Button* joinNetworkBtn;
+
 CheckBox* wifiEnabledCB;
 
 Button* startBtn;
@@ -123,20 +129,28 @@ TextItem* wifiHelpText3;
 MenuItem* debugMenuItems[5];
 NumberField* displayCurrentText;
 NumberField* displayCurrentAfterScaleText;
+NumberField* ledRuntimeText;
 NumberField* vBatMeasured;
 NumberField* vBatText;
 NumberField* hzText;
+NumberField* loopMaxText;
 NumberField* freeHeapText;
 NumberField* heapSizeText;
 NumberField* laserValue;
+NumberField* radioOverrunsText;
+NumberField* radioCrcErrorsText;
+NumberField* goodputText;
+NumberField* sendWindowText;
+CheckBox* radioCaptureCB;
 
 
 Menu* connectionsMenuMaster;
-// Menu* viewerMenu;
+Menu* viewerMenu;
+ListView* viewerList;
 Menu* targetTimeMenu;
 SubMenu* targetTimeSubMenu;
 
-FrameSection* frameSections = new FrameSection[3];
+FrameSection* frameSections = new FrameSection[4];
 
 volatile uint32_t triggerCount = 0;
 volatile timeMs_t lastTriggerMs = 0;
@@ -154,9 +168,9 @@ bool isTriggered() {
   return !digitalRead(PIN_LASER);
 }
 
-// void updateViewer(); // found in GuiLogic
+void liveTriggerAdded(const Trigger& trigger); // found in WiFiLogic
 
 void masterTrigger(Trigger trigger) {
   spiffsLogic.addTrigger(trigger);
-  // updateViewer();
+  liveTriggerAdded(trigger);
 }
\ No newline at end of file
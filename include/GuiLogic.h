@@ -15,13 +15,15 @@
 #include <WiFiLogic.h>
 #include <startgun.h>
 #include <SPIFFSLogic.h>
+#include <SessionViewer.h>
+#include <Overlay.h>
 #include <WiFiLogic.h>
 
 #define POWER_SAVING_MODE_OFF 0
 #define POWER_SAVING_MODE_MEDIUM 1
 #define POWER_SAVING_MODE_HIGH 2
 
-#define MASTER_FRAMES 3
+#define MASTER_FRAMES 4 // the viewer is last and only shown on displays
 #define SLAVE_FRAMES 3
 
 // TextItem* connectionItems[MAX_CONNECTIONS];
@@ -36,9 +38,11 @@ int getLEDCount() {
   return isDisplaySelect->getValue() ? NUM_LEDS_DISPLAY : NUM_LEDS_LASER;
 }
 
-uint16_t pixelConverter(uint16_t x, uint16_t y) {
-  y = 7 - y;
-  return (8 * 31) - x * 8 + (x % 2 == 0 ? (7 - y) : y);
+/**
+ * Serpentine 8x32 panel, columns from the right. constexpr so LedPixelMap can tabulate it at compile time
+ */
+constexpr uint16_t pixelConverter(uint16_t x, uint16_t y) {
+  return (8 * 31) - x * 8 + (x % 2 == 0 ? y : 7 - y);
 }
 
 void showDebugChanged() {
@@ -51,6 +55,11 @@ void simpleInputChanged() {
   writePreferences();
 }
 
+void radioCaptureChanged() {
+  setRadioCaptureEnabled(radioCaptureCB->isChecked());
+  writePreferences();
+}
+
 void reboot() {
   ESP.restart();
 }
@@ -66,12 +75,15 @@ void wiFiCredentialsChanged() {
 
 void initStationDisplay() {
   displayBrightnessInput->setHidden(!isDisplaySelect->getValue());
+  batteryLifeInput->setHidden(!isDisplaySelect->getValue());
   displayTimeInput->setHidden(!isDisplaySelect->getValue());
   fontSizeSelect->setHidden(!isDisplaySelect->getValue());
   lapDisplayTypeSelect->setHidden(!isDisplaySelect->getValue());
   cloudUploadEnabled->setHidden(!isDisplaySelect->getValue());
   uploadNowBtn->setHidden(!isDisplaySelect->getValue());
+  findFreeNetworkBtn->setHidden(!isDisplaySelect->getValue());
   // only on lasers
+  joinNetworkBtn->setHidden(isDisplaySelect->getValue());
   stationTypeSelect->setHidden(isDisplaySelect->getValue());
   minDelayInput->setHidden(isDisplaySelect->getValue());
   // wifiEnabledCB->setHidden(isDisplaySelect->getValue());
@@ -151,45 +163,39 @@ void isDisplayChanged() {
 //   }
 // }
 
-void msOverlay(ScreenDisplay *display, DisplayUiState* state) {
-  display->setColor(BLACK);
-  display->fillRect(0, 0, 128, 13);
-  display->setColor(WHITE);
-  display->fillRect(7, 13, 114, 1);
-
-  char strConnection[30];
-  strConnection[0] = 0;
-  if(!isDisplaySelect->getValue()) { // slave
-    if(masterConnected) {
-      if(slaveTriggers.getSize() > 0) {
-        sprintf(strConnection, "Connected(%i qued)", slaveTriggers.getSize());
-      } else {
-        sprintf(strConnection, "Connected");
-      }
-    } else {
-      sprintf(strConnection, "No connection");
+// what msOverlay shows. Changes invalidate the screen
+int overlayFreeStorage = -1; // percent. -1 if unknown
+uint32_t overlayCatalogVersion = UINT32_MAX;
+bool overlayMasterConnected = false;
+size_t overlayOutboxSize = 0;
+
+/**
+ * Free storage is only read from SPIFFS after the session files changed instead of on every frame
+ */
+void handleOverlayData() {
+  if(isDisplaySelect->getValue()) {
+    if(spiffsLogic.getCatalogVersion() == overlayCatalogVersion) return;
+    overlayCatalogVersion = spiffsLogic.getCatalogVersion();
+    size_t bytesTotal = spiffsLogic.getBytesTotal();
+    int freeStorage = -1;
+    if(bytesTotal > 0) {
+      freeStorage = 100 - int(float(spiffsLogic.getBytesUsed()) / float(bytesTotal) * 100);
     }
-    display->setFont(ArialMT_Plain_10);
-    display->setTextAlignment(TEXT_ALIGN_LEFT);
-    display->drawString(0, 0, String(strConnection));
-    // type of station
-    display->setTextAlignment(TEXT_ALIGN_RIGHT);
-    display->drawString(128, 0, String(stationTypeSelect->getSelectedShort()));
-  } else {
-    size_t lapsCount = spiffsLogic.getActiveTraining().getLapsCount();
-    size_t bytesUsed = spiffsLogic.getBytesTotal();
-    if(bytesUsed > 0) {
-      size_t memUsed = float(spiffsLogic.getBytesUsed()) / float(bytesUsed) * 100;
-      char memUsedStr[20];
-      memUsedStr[0] = 0;
-      sprintf(memUsedStr, "Free storage: %i%%", 100 - memUsed);
-      display->setFont(ArialMT_Plain_10);
-      display->setTextAlignment(TEXT_ALIGN_LEFT);
-      display->drawString(0, 0, String(memUsedStr));
+    if(freeStorage != overlayFreeStorage) {
+      overlayFreeStorage = freeStorage;
+      invalidateUI();
     }
+  } else if(masterConnected != overlayMasterConnected || slaveOutbox.getSize() != overlayOutboxSize) {
+    overlayMasterConnected = masterConnected;
+    overlayOutboxSize = slaveOutbox.getSize();
+    invalidateUI();
   }
 }
 
+void msOverlay(ScreenDisplay *display, DisplayUiState* state) {
+  drawOverlay(display, overlayFreeStorage, overlayMasterConnected, overlayOutboxSize, isDisplaySelect, stationTypeSelect);
+}
+
 void drawFrameWiFi(ScreenDisplay *display, DisplayUiState* state, int16_t x, int16_t y) {
   // draw an xbm image.
   display->drawXbm(x + 34, y + 14, WiFi_Logo_width, WiFi_Logo_height, WiFi_Logo_bits);
@@ -325,127 +331,58 @@ void timToStr(timeMs_t timeMs, char* str, bool oneMsDigit = false) {
   }
 }
 
-#define VIEWER_MAX_TRIGGERS 15
-
-// void showOlder() {
-
-// }
-
-// void showNewer() {
-
-// }
-
-// size_t viewerLapOffset = 0;
-
 /**
- * Viewer variables
+ * Viewer of the active session. Rows are read from the session file when they become visible
  */
-char* viewerTimeStrings[1000];
-size_t viewerTimeStringsCount = 0;
-MenuItem* viewerMenuItems[1000];
-size_t viewerMenuItemCount = 0;
-
-// Button* showOlderBtn = new Button("Show older", showOlder);
-// Button* showNewerBtn = new Button("Show older", showNewer);
-
-// void addCheckpointToViewer(timeMs_t checkpointDurationMs, uint16_t millimeters, uint16_t currentCheckpoint, uint8_t triggerType) {
-//     char* timeStr = new char[20];
-//     if(triggerType == STATION_TRIGGER_TYPE_CHECKPOINT) {
-//       sprintf(timeStr, "# %i %im | ", currentCheckpoint + 1, int(millimeters / 1000));
-//     } else {
-//       sprintf(timeStr, "# %i | ", currentCheckpoint + 1);
-//     }
-//     viewerTimeStrings[viewerTimeStringsCount++] = timeStr;
-//     timToStr(checkpointDurationMs, timeStr + strlen(timeStr));
-//     TextItem* textItem = new TextItem(timeStr, true, TEXT_ALIGN_LEFT);
-//     viewerMenuItems[viewerMenuItemCount++] = textItem;
-//     viewerMenu->prependItem(textItem, false);
-// }
-
-// void addLapToViewer(timeMs_t lapDurationMs, int16_t lapCount) {
-//     char* timeStr = new char[25];
-//     sprintf(timeStr, "Lap %i | ", lapCount);
-//     viewerTimeStrings[viewerTimeStringsCount++] = timeStr;
-//     timToStr(lapDurationMs, timeStr + strlen(timeStr));
-//     TextItem* textItem = new TextItem(timeStr, true, TEXT_ALIGN_LEFT);
-//     viewerMenuItems[viewerMenuItemCount++] = textItem;
-//     viewerMenu->prependItem(textItem, false);
-// }
-
-// void addLineToViewer() {
-//   Seperator* seperator = new Seperator();
-//   viewerMenuItems[viewerMenuItemCount++] = seperator;
-//   viewerMenu->prependItem(seperator, false);
-// }
-
-// void updateViewer() {
-//   TrainingsSession& session = spiffsLogic.getActiveTraining();
-//   viewerMenu->removeAll();
-  
-//   for (size_t i = 0; i < viewerMenuItemCount; i++) {
-//     delete viewerMenuItems[i];
-//   }
-//   viewerMenuItemCount = 0;
-
-//   for (size_t i = 0; i < viewerTimeStringsCount; i++) {
-//     delete[] viewerTimeStrings[i];
-//   }
-//   viewerTimeStringsCount = 0;
-
-//   timeMs_t lapStart = 0;
-//   timeMs_t lastTrigger = 0;
-//   int16_t lastMillimeters = -1;
-//   int16_t lapCount = 1 + max(0, int(session.getTriggerCount()) - VIEWER_MAX_TRIGGERS); // start at 1 to have the first display as 1
-//   bool checkpointPassed = false;
-//   bool lapStarted = false;
-//   uint16_t currentCheckpoint = 0;
-//   for (size_t i = max(0, int(session.getTriggerCount()) - VIEWER_MAX_TRIGGERS); i < session.getTriggerCount(); i++) {
-//     const Trigger& t = session.getTrigger(i);
-//     if(lapStarted && (t.triggerType == STATION_TRIGGER_TYPE_FINISH || t.triggerType == STATION_TRIGGER_TYPE_START_FINISH)) {
-//       char* timeStr = new char[15];
-//       viewerTimeStrings[viewerTimeStringsCount++] = timeStr;
-//       if(checkpointPassed) {
-//         addCheckpointToViewer(t.timeMs - lastTrigger, t.millimeters, currentCheckpoint, t.triggerType);
-//       }
-//       addLapToViewer(t.timeMs - lapStart, lapCount);
-//       addLineToViewer();
-//       lapStarted = false;
-//       lapCount++;
-//     }
-//     if(t.triggerType == STATION_TRIGGER_TYPE_START || t.triggerType == STATION_TRIGGER_TYPE_START_FINISH) {
-//       lapStart = t.timeMs;
-//       lastTrigger = t.timeMs;
-//       lastMillimeters = -1;
-//       checkpointPassed = false;
-//       lapStarted = true;
-//       currentCheckpoint = 0;
-//     }
-//     if(lapStarted && t.triggerType == STATION_TRIGGER_TYPE_CHECKPOINT) {
-//       if(int(t.millimeters) <= lastMillimeters) continue;
-//       addCheckpointToViewer(t.timeMs - lastTrigger, t.millimeters, currentCheckpoint, t.triggerType);
-//       lastMillimeters = t.millimeters;
-//       lastTrigger = t.timeMs;
-//       checkpointPassed = true;
-//       currentCheckpoint++;
-//     }
-//   }
-//   if(lapStarted && !checkpointPassed) {
-//     TextItem* runningTxt = new TextItem("Running...");
-//     viewerMenuItems[viewerMenuItemCount++] = runningTxt;
-//     viewerMenu->prependItem(runningTxt, false);
-//   }
+SessionViewer sessionViewer;
+uint32_t viewerCatalogVersion = UINT32_MAX;
+
+size_t viewerRowCount() {
+  return sessionViewer.getRowCount();
+}
+
+size_t viewerRows(size_t first, size_t count, ListRow* rows) {
+  ViewerRow viewerRows[LIST_VIEW_WINDOW_ROWS];
+  count = sessionViewer.getRows(spiffsLogic.getActiveTraining(), first, min(count, size_t(LIST_VIEW_WINDOW_ROWS)), viewerRows);
+  for (size_t i = 0; i < count; i++) {
+    const ViewerRow& row = viewerRows[i];
+    ListRow& listRow = rows[i];
+    listRow.separator = row.type != VIEWER_ROW_CHECKPOINT; // between laps
+    switch(row.type) {
+      case VIEWER_ROW_RUNNING:
+        snprintf(listRow.label, LIST_VIEW_LABEL_SIZE, "Lap %u", row.number);
+        strcpy(listRow.value, "Running...");
+        break;
+      case VIEWER_ROW_LAP:
+        snprintf(listRow.label, LIST_VIEW_LABEL_SIZE, "Lap %u", row.number);
+        timToStr(row.timeMs, listRow.value);
+        break;
+      case VIEWER_ROW_CHECKPOINT:
+        if(row.triggerType == STATION_TRIGGER_TYPE_CHECKPOINT) {
+          snprintf(listRow.label, LIST_VIEW_LABEL_SIZE, "# %u %um", row.number, row.millimeters / 1000);
+        } else {
+          snprintf(listRow.label, LIST_VIEW_LABEL_SIZE, "# %u", row.number);
+        }
+        timToStr(row.timeMs, listRow.value);
+        break;
+    }
+  }
+  return count;
+}
 
-//   // char* fileNameText = new char[20];
-//   // viewerTimeStrings[viewerTimeStringsCount++] = fileNameText;
-//   // sprintf(fileNameText, "File: %s", session->getFileName());
-//   // TextItem* fileNameLabel = new TextItem(fileNameText, true);
-//   // viewerMenuItems[viewerMenuItemCount++] = fileNameLabel;
-//   // viewerMenu->prependItem(fileNameLabel);
-  
-//   // TextItem* viewerLabel = new TextItem("Viewer");
-//   // viewerMenuItems[viewerMenuItemCount++] = viewerLabel;
-//   // viewerMenu->prependItem(viewerLabel);
-// }
+/**
+ * Indexes new triggers of the active session. Only runs after the session files changed
+ */
+void handleViewer() {
+  if(!isDisplaySelect->getValue()) return;
+  if(spiffsLogic.getCatalogVersion() == viewerCatalogVersion) return;
+  viewerCatalogVersion = spiffsLogic.getCatalogVersion();
+  const size_t rowsBefore = sessionViewer.getRowCount();
+  if(sessionViewer.update(spiffsLogic.getActiveTraining())) {
+    const size_t rows = sessionViewer.getRowCount();
+    viewerList->refresh(rows > rowsBefore ? rows - rowsBefore : 0);
+  }
+}
 
 void trainingsModeChanged() {
   Serial.println("trainingsMode changed");
@@ -474,6 +411,25 @@ void lapDisplayTypeChanged() {
   writePreferences();
 }
 
+void radioNetworkChanged() {
+  applyRadioNetwork(radioNetworkInput->getValue() - 1);
+  writePreferences();
+}
+
+void findFreeNetworkPressed() {
+  uiManager.popup("Scanning networks...");
+  uiManager.handle(true);
+  uint8_t network = findFreeRadioNetwork();
+  radioNetworkInput->setValue(network + 1);
+  radioNetworkChanged();
+  uiManager.popup(nullptr);
+}
+
+void joinNetworkPressed() {
+  uiManager.popup("Looking for display...");
+  startRadioNetworkJoin();
+}
+
 void deleteAllSessionsPressed() {
   spiffsLogic.deleteAllSessions();
 }
@@ -482,22 +438,36 @@ void beginLCDDisplay() {
   distFromStartInput = new NumberField("Dist. from start", "m", 0.1, 0, 655, 1, 10, simpleInputChanged);
   minDelayInput = new NumberField("Min. delay", "s", 0.1, 0.5, 1000, 1, 0, simpleInputChanged);
 
-  displayCurrentText = new NumberField("Disp.", "A", 0.01, 0, 100, 2);
+  displayCurrentText = new NumberField("Disp.", "mA", 1, 0, 100000, 0);
   displayCurrentText->setEditable(false);
-  displayCurrentAfterScaleText = new NumberField("Disp. scaled", "A", 0.01, 0, 100, 2);
+  displayCurrentAfterScaleText = new NumberField("Disp. scaled", "mA", 1, 0, 100000, 0);
   displayCurrentAfterScaleText->setEditable(false);
+  ledRuntimeText = new NumberField("LED runtime", "h", 0.1, 0, 100000, 1);
+  ledRuntimeText->setEditable(false);
   vBatMeasured = new NumberField("vMeasured", "V", 0.01, 0, 100, 2);
   vBatMeasured->setEditable(false);
   vBatText = new NumberField("vBat", "V", 0.01, 0, 100, 2);
   vBatText->setEditable(false);
   hzText = new NumberField("Loop", "Hz", 1, 0, 100000000, 0);
   hzText->setEditable(false);
+  loopMaxText = new NumberField("Loop max", "us", 1, 0, 100000000, 0);
+  loopMaxText->setEditable(false);
   displayBrightnessInput = new NumberField("Brightness", "%", 1, 5, 100, 0, 30, simpleInputChanged);
+  batteryLifeInput = new NumberField("Battery life", "h", 1, 2, 100, 0, LED_BATTERY_LIFE_DEFAULT_H, simpleInputChanged);
   displayTimeInput = new NumberField("Display time", "s", 0.5, 0.5, 100, 1, 3, simpleInputChanged);
   freeHeapText = new NumberField("Free", "b", 1, 0, UINT16_MAX, 0);
   freeHeapText->setEditable(false);
   heapSizeText = new NumberField("Size", "b", 1, 0, UINT16_MAX, 0);
   heapSizeText->setEditable(false);
+  radioOverrunsText = new NumberField("Rx overruns", "", 1, 0, UINT32_MAX, 0);
+  radioOverrunsText->setEditable(false);
+  radioCrcErrorsText = new NumberField("CRC errors", "", 1, 0, UINT32_MAX, 0);
+  radioCrcErrorsText->setEditable(false);
+  goodputText = new NumberField("Goodput", "trg/s", 0.01, 0, 1000, 2);
+  goodputText->setEditable(false);
+  sendWindowText = new NumberField("Send window", "trg", 1, 0, 100, 0);
+  sendWindowText->setEditable(false);
+  radioCaptureCB = new CheckBox("Radio capture", false, false, radioCaptureChanged);
   showAdvancedCB = new CheckBox("Show advanced", false, false, showDebugChanged);
   advancedText = new TextItem("Advanced");
   trainingsModeSelect = new Select("Trainings mode", trainingsModeChanged);
@@ -560,6 +530,10 @@ void beginLCDDisplay() {
 
   uploadNowBtn = new Button("Upload now", tryInitUpload);
 
+  radioNetworkInput = new NumberField("Radio network", "", 1, 1, RADIO_NETWORK_COUNT, 0, RADIO_NETWORK_JOIN + 1, radioNetworkChanged);
+  findFreeNetworkBtn = new Button("Find free network", findFreeNetworkPressed);
+  joinNetworkBtn = new Button("Join display", joinNetworkPressed);
+
   fontSizeSelect = new Select("Display font size", writePreferences);
   fontSizeSelect->addOption("Large", "L");
   fontSizeSelect->addOption("Small", "S");
@@ -570,7 +544,7 @@ void beginLCDDisplay() {
   Menu* debugMenu = new Menu();
   Menu* menuFactoryReset = new Menu("No");
   // connectionsMenuMaster = new Menu();
-  // viewerMenu = new Menu();
+  viewerMenu = new Menu();
   Menu* wifiMenu = new Menu();
   Menu* infoMenu = new Menu();
   Menu* startMenu = new Menu();
@@ -594,8 +568,12 @@ void beginLCDDisplay() {
   setupMenu->addItem(displayTimeInput);
   setupMenu->addItem(minDelayInput);
   setupMenu->addItem(displayBrightnessInput);
+  setupMenu->addItem(batteryLifeInput);
   setupMenu->addItem(lapDisplayTypeSelect);
   setupMenu->addItem(fontSizeSelect);
+  setupMenu->addItem(radioNetworkInput);
+  setupMenu->addItem(findFreeNetworkBtn);
+  setupMenu->addItem(joinNetworkBtn);
 
     startMenu->addItem(new TextItem("Start gun"));
     startMenu->addItem(startGunBtn);
@@ -631,13 +609,21 @@ void beginLCDDisplay() {
       debugMenu->addItem(new TextItem("Info for nerds"));
       debugMenu->addItem(displayCurrentText);
       debugMenu->addItem(displayCurrentAfterScaleText);
+      debugMenu->addItem(ledRuntimeText);
       debugMenu->addItem(vBatMeasured);
       debugMenu->addItem(vBatText);
       debugMenu->addItem(hzText);
+      debugMenu->addItem(loopMaxText);
       debugMenu->addItem(new TextItem("Heap memory"));
       debugMenu->addItem(freeHeapText);
       debugMenu->addItem(heapSizeText);
       debugMenu->addItem(laserValue);
+      debugMenu->addItem(new TextItem("Radio"));
+      debugMenu->addItem(radioOverrunsText);
+      debugMenu->addItem(radioCrcErrorsText);
+      debugMenu->addItem(goodputText);
+      debugMenu->addItem(sendWindowText);
+      debugMenu->addItem(radioCaptureCB);
       debugMenu->addItem(new Button("Reboot", reboot));
 
   setupMenu->addItem(new SubMenu("Info", infoMenu));
@@ -648,7 +634,9 @@ void beginLCDDisplay() {
     infoMenu->addItem(new TextItem("www.roller-results.com", true));
     infoMenu->addItem(new TextItem("By Timo Lehenrtz", true));
 
-  // viewerMenu->addItem(new TextItem("Viewer"));
+  viewerMenu->addItem(new TextItem("Viewer"));
+  viewerList = new ListView(viewerRowCount, viewerRows, "No laps yet");
+  viewerMenu->addItem(viewerList);
 
 
   // connectionsMenuMaster->addItem(new TextItem("Connections"));
@@ -667,10 +655,13 @@ void beginLCDDisplay() {
   frameSections[0] = FrameSection(drawSetup, setupMenu);
   frameSections[1] = FrameSection(drawStartGun, startMenu);
   // frameSections[2] = FrameSection(drawConnections, connectionsMenuMaster);
-  // frameSections[2] = FrameSection(drawViewer, viewerMenu);
   frameSections[2] = FrameSection(drawFrameWiFi, wifiMenu);
+  frameSections[3] = FrameSection(drawViewer, viewerMenu);
 
-  uiManager.begin(overlayCallbacks, overlaysCount, frameSections, 3);
+  uiManager.begin(overlayCallbacks, overlaysCount, frameSections, SLAVE_FRAMES);
+  if(!display.beginAsyncFlush()) {
+    Serial.println("OLED flush task could not be started. Flushing from the loop");
+  }
 
   // for (size_t i = 0; i < MAX_CONNECTIONS; i++) {
   //   connectionItems[i] = nullptr;
@@ -685,23 +676,56 @@ void beginLCDDisplay() {
 void beginLEDDisplay() {
   FastLED.clearData();
   FastLED.addLeds<NEOPIXEL, PIN_WS2812b>(leds, NUM_LEDS_DISPLAY);
-  matrix = LedMatrix(leds, NUM_LEDS_DISPLAY, pixelConverter);
+  matrix = LedMatrix(leds, NUM_LEDS_DISPLAY, LedPixelMap<pixelConverter, 32, 8>::pixels);
 }
 
 /**
  * @brief probably acurate +-10%
+ * @return mA at full brightness
  */
-float predictLEDCurrentDraw() {
-  float currentDraw = 0; // w
-  for (size_t i = 0; i < getLEDCount(); i++) {
-    currentDraw += leds[i].r / 255.0 * MAX_AMPS_PER_PIXEL / 3.0;
-    currentDraw += leds[i].g / 255.0 * MAX_AMPS_PER_PIXEL / 3.0;
-    currentDraw += leds[i].b / 255.0 * MAX_AMPS_PER_PIXEL / 3.0;
+uint32_t predictLEDCurrentDraw() {
+  const uint8_t* channels = (const uint8_t*) leds;
+  uint32_t channelSum = 0;
+  for (size_t i = 0; i < getLEDCount() * 3; i++) {
+    channelSum += channels[i];
   }
-  return currentDraw;
+  return channelSum * MAX_MILLIAMPS_PER_PIXEL / (3 * 255);
 }
 
-timeMs_t lastLEDUpdate = 0;
+/**
+ * The frame on the LEDs. show() takes ~7.7ms for the matrix with interrupts disabled, so it is only called when the frame changed
+ */
+CRGB shownLeds[NUM_LEDS_DISPLAY];
+uint8_t shownBrightness = 0;
+timeMs_t lastLEDShow = 0;
+uint32_t shownLEDCurrent = 0; // mA at full brightness
+
+/**
+ * Brightness governor. The current limit follows the average draw, so a full battery lasts batteryLifeInput hours
+ */
+uint32_t ledLimitMA = MAX_CONTINUOUS_MILLIAMPS;
+int32_t ledAverageMAQ16 = 0; // drawn current in 1/65536 mA, averaged over LED_AVERAGE_FRAMES
+uint32_t ledGovernorFrames = 0;
+int32_t ledBrightnessQ8 = 0.3 * 256; // low passed brightness in 1/256
+
+void updateLEDGovernor(uint32_t drawnMA) {
+  ledAverageMAQ16 += (int32_t(drawnMA << 16) - ledAverageMAQ16) / LED_AVERAGE_FRAMES;
+  if(++ledGovernorFrames % LED_GOVERNOR_STEP_FRAMES != 0) return;
+  const uint32_t budgetMA = LED_BATTERY_MAH / uint32_t(batteryLifeInput->getValue());
+  const uint32_t averageMA = ledAverageMAQ16 >> 16;
+  if(averageMA > budgetMA) {
+    if(drawnMA > budgetMA && ledLimitMA > LED_MIN_MILLIAMPS) ledLimitMA--; // not while the lagging average catches up
+  } else if(ledLimitMA < MAX_CONTINUOUS_MILLIAMPS) {
+    ledLimitMA++;
+  }
+}
+
+/**
+ * @return hours a full battery lasts at the average draw
+ */
+float getLEDRuntimeHours() {
+  return ledAverageMAQ16 <= 0 ? 0 : float(LED_BATTERY_MAH) * 65536 / ledAverageMAQ16;
+}
 
 void ledDisplayTime(timeMs_t time, bool oneDigit) {
   if(fontSizeSelect->getValue() == 0) {// large
@@ -724,10 +748,7 @@ bool isLaserTimeout() {
 }
 
 void handleLEDS() {
-  float stationDisplayBrightness = 1;
-  static float lastDisplayBrightness = 0.3;
-  if(millis() - lastLEDUpdate < 1000.0 / 30.0) return;
-  lastLEDUpdate = millis();
+  uint32_t stationDisplayPermille = 1000;
   FastLED.clear();
   TrainingsSession& session = spiffsLogic.getActiveTraining();
   if(isDisplaySelect->getValue()) {
@@ -794,7 +815,9 @@ void handleLEDS() {
     static size_t ledState = 0;
     size_t prevLedState = ledState;
     static timeMs_t lastLEDStateChange = 0;
-    for (int i = 0; i < min(double(getLEDCount()), millis() / 150.0 - 7); i++) {
+    // breathing at 1000 / (2 PI) ms per radian with sin16(), one 16 bit turn is 2 PI
+    const uint16_t phase = uint64_t(uint32_t(millis() + timeSyncOffset)) * 683565 >> 16;
+    for (int i = 0; i < getLEDCount() && (i + 7) * 150 < millis(); i++) {
       if(isTriggered()) {
         ledState = 1;
         leds[i] = CRGB(0x555555);
@@ -803,37 +826,58 @@ void handleLEDS() {
         leds[i] = CRGB::Red;
       } else {
         ledState = 3;
-        double value = (sin(((millis() + timeSyncOffset) - i * 750) / 1000.0) + 1.0) / 2.0;
-        leds[i] = CRGB(60 * value, 0, 40 * value);
+        const uint8_t value = (sin16(phase - i * 7823) + 32768) >> 8; // 750ms per led
+        leds[i] = CRGB(scale8(60, value), 0, scale8(40, value));
       }
     }
     if(prevLedState != ledState) {
       lastLEDStateChange = millis();
     }
     if(millis() - lastLEDStateChange < 3000) {
-      stationDisplayBrightness = 1;
+      stationDisplayPermille = 1000;
     } else {
-      stationDisplayBrightness = 0.001;
+      stationDisplayPermille = 1;
     }
   }
 
-  // debug
-  freeHeapText->setValue(ESP.getFreeHeap());
-  heapSizeText->setValue(ESP.getHeapSize());
-  laserValue->setValue(digitalRead(PIN_LASER));
+  // debug. Only while the debug menu can be shown, the changing values would keep the screen redrawing
+  const bool showDebug = showAdvancedCB->isChecked();
+  if(showDebug) {
+    freeHeapText->setValue(ESP.getFreeHeap());
+    heapSizeText->setValue(ESP.getHeapSize());
+    laserValue->setValue(digitalRead(PIN_LASER));
+    radioOverrunsText->setValue(radioOverruns);
+    radioCrcErrorsText->setValue(radioCrcErrors);
+    goodputText->setValue(slaveGoodput);
+    sendWindowText->setValue(slaveSendWindow);
+  }
 
   // handle brightness
-  float displayCurrent = predictLEDCurrentDraw();
-  displayCurrentText->setValue(displayCurrent);
-  const float inputBrightness = isDisplaySelect->getValue() ? displayBrightnessInput->getValue() / 100.0 * 255.0 : stationDisplayBrightness * 255.0;
-  float displayBrightness = MAX_CONTINUOUS_AMPS / displayCurrent * inputBrightness;
+  const bool pixelsChanged = memcmp(shownLeds, leds, sizeof(leds)) != 0;
+  if(pixelsChanged) {
+    memcpy(shownLeds, leds, sizeof(leds));
+    shownLEDCurrent = predictLEDCurrentDraw();
+  }
+  const uint32_t displayCurrent = shownLEDCurrent;
+  const uint32_t inputPermille = isDisplaySelect->getValue() ? uint32_t(displayBrightnessInput->getValue() * 10) : stationDisplayPermille;
+  // scaled so the frame draws inputPermille of the limit
+  uint32_t displayBrightness = displayCurrent == 0 ? 150 : ledLimitMA * inputPermille * 255 / (1000 * displayCurrent);
   if(displayBrightness > 150) displayBrightness = 150;
-  displayCurrentAfterScaleText->setValue(displayCurrent * (displayBrightness / 255.0));
-  float brightnessLPF = 0.05;
-  displayBrightness = displayBrightness * brightnessLPF + lastDisplayBrightness * (1 - brightnessLPF);
-  lastDisplayBrightness = displayBrightness;
-  FastLED.setBrightness(displayBrightness);
-  FastLED.show();
+  ledBrightnessQ8 += (int32_t(displayBrightness << 8) - ledBrightnessQ8) / 20;
+  FastLED.setBrightness(ledBrightnessQ8 >> 8);
+  const uint32_t drawnCurrent = displayCurrent * FastLED.getBrightness() / 255;
+  updateLEDGovernor(drawnCurrent);
+  if(showDebug) {
+    displayCurrentText->setValue(displayCurrent);
+    displayCurrentAfterScaleText->setValue(drawnCurrent);
+    ledRuntimeText->setValue(getLEDRuntimeHours());
+  }
+  // refreshed once in a while anyway in case a frame got corrupted on the line
+  if(pixelsChanged || FastLED.getBrightness() != shownBrightness || lastLEDShow == 0 || millis() - lastLEDShow > LED_REFRESH_MS) {
+    FastLED.show();
+    shownBrightness = FastLED.getBrightness();
+    lastLEDShow = millis();
+  }
   if(millis() < 1000) {
     digitalWrite(PIN_LED_WHITE, millis() % 100 > 50);
   } else {
@@ -15,14 +15,15 @@
 #include <GuiLogic.h>
 #include <radio.h>
 #include <DoubleLinkedList.h>
+#include <SlaveOutbox.h>
 
 #define MASTER_TIMEOUT_MS 11000
+#define SLAVE_TRIGGER_BATCH_MAX 4 // triggers per frame
+#define GOODPUT_INTERVAL_MS 10000
 
 void guiRemoveConnection(uint8_t address);
 void guiSetConnection(uint8_t address, int millimeters, uint8_t lq, uint8_t stationType);
 
-DoubleLinkedList<Trigger> slaveTriggers = DoubleLinkedList<Trigger>(); // for slaves
-
 /**
  * Slave variables
  */
@@ -32,6 +33,14 @@ timeMs_t timeSyncOffset = 0;
 timeMs_t nextSlaveTriggerSend = 0;
 timeMs_t nextTriggerSend = 0;
 bool masterConnected = false;
+Trigger lastSentSlaveTriggers[SLAVE_TRIGGER_BATCH_MAX]; // in master time. Acks are matched against it
+uint8_t lastSentSlaveTriggerCount = 0; // > 0 while waiting for an ack
+timeMs_t lastSlaveTriggerSendMs = 0;
+uint8_t slaveSendWindow = 1; // triggers per frame. Grows by one per ack while the queue is deeper, halves on a missing ack
+timeMs_t ackLatencyMs = 0; // smoothed time from sending to the masters copy
+uint32_t ackedTriggers = 0;
+timeMs_t goodputStartMs = 0;
+float slaveGoodput = 0; // acked triggers per second
 
 
 /**
@@ -39,9 +48,9 @@ bool masterConnected = false;
  */
 timeMs_t lastTimeSync = 0;
 
-void sendTrigger(Trigger& trigger) {
-    Serial.println("Sending trigger");
-    sceduleSend((uint8_t*) &trigger, sizeof(Trigger));
+void sendTriggers(const Trigger* triggers, size_t count) {
+    Serial.printf("Sending %i triggers\n", count);
+    sceduleSend((uint8_t*) triggers, count * sizeof(Trigger));
 }
 
 void sendTimeSync() {
@@ -62,75 +71,128 @@ struct TimeSyncMasterToSlave {
 };
 
 void beginMasterSlaveLogic() {
-
+    slaveOutbox.begin();
 }
 
 void slaveTrigger(timeMs_t atMs, uint8_t triggerType, uint16_t millimeters) {
-    Trigger trigger = Trigger { atMs, millimeters, triggerType };
-    trigger.timeMs += timeSyncOffset;
-    slaveTriggers.pushBack(trigger);
-    Serial.printf("Slave trigger #%i, triggerType: %i, millimeters: %i\n", slaveTriggers.getSize(), triggerType, millimeters);
+    slaveOutbox.add(atMs, triggerType, millimeters);
+    Serial.printf("Slave trigger #%i, triggerType: %i, millimeters: %i\n", slaveOutbox.getSize(), triggerType, millimeters);
+}
+
+bool isLastSentSlaveBatch(const uint8_t* byteArr) {
+    for (size_t i = 0; i < lastSentSlaveTriggerCount; i++) {
+        Trigger trigger;
+        memcpy(&trigger, byteArr + i * sizeof(Trigger), sizeof(Trigger));
+        if(!(lastSentSlaveTriggers[i] == trigger)) return false;
+    }
+    return true;
+}
+
+/**
+ * Additive increase. The next batch goes out right away instead of waiting for the retry timeout
+ */
+void slaveBatchAcked() {
+    timeMs_t latency = millis() - lastSlaveTriggerSendMs;
+    ackLatencyMs = ackLatencyMs == 0 ? latency : (ackLatencyMs * 7 + latency) / 8;
+    Serial.printf("Master got my %i triggers (ack latency: %ims)\n", lastSentSlaveTriggerCount, latency);
+    for (size_t i = 0; i < lastSentSlaveTriggerCount; i++) {
+        slaveOutbox.retireFirst();
+    }
+    ackedTriggers += lastSentSlaveTriggerCount;
+    lastSentSlaveTriggerCount = 0;
+    if(slaveOutbox.getSize() > slaveSendWindow && slaveSendWindow < SLAVE_TRIGGER_BATCH_MAX) {
+        slaveSendWindow++;
+    }
+    nextTriggerSend = millis() + random(0, 2) * (radio.getTimeOnAir(RADIO_FRAME_HEADER_SIZE + sizeof(Trigger)) / 1000 + 10); // jitter against other stations
+}
+
+/**
+ * Sends up to slaveSendWindow of the oldest queued triggers in one frame.
+ * Sending again before an ack arrived counts as loss and halves the window
+ */
+void sendSlaveTriggers() {
+    if(lastSentSlaveTriggerCount > 0) {
+        slaveSendWindow = max(1, slaveSendWindow / 2);
+    }
+    uint8_t count = 0;
+    while(count < slaveSendWindow && count < slaveOutbox.getSize()) {
+        Trigger trigger = slaveOutbox.get(count, timeSyncOffset);
+        if(trigger.timeMs < 0) break;
+        lastSentSlaveTriggers[count++] = trigger;
+    }
+    if(count == 0) {
+        Serial.println("removing negative trigger");
+        slaveOutbox.retireFirst();
+        lastSentSlaveTriggerCount = 0;
+        return;
+    }
+    lastSentSlaveTriggerCount = count;
+    lastSlaveTriggerSendMs = millis();
+    sendTriggers(lastSentSlaveTriggers, count);
+    timeMs_t airtime = radio.getTimeOnAir(RADIO_FRAME_HEADER_SIZE + count * sizeof(Trigger)) / 1000 + 10;
+    timeMs_t triggerTimeout = max(timeMs_t(random(3, 6) * airtime), ackLatencyMs * 2);
+    nextTriggerSend = millis() + triggerTimeout;
+    Serial.printf("next trigger timeout: %ims, window: %i\n", triggerTimeout, slaveSendWindow);
 }
 
 bool isTriggerValid(Trigger t) {
     return t.triggerType <= STATION_TRIGGER_TYPE_PARCOUR_FINISH;
 }
 
-void radioReceived(const uint8_t* byteArr, size_t size) {
+void radioReceived(const uint8_t* byteArr, size_t size, timeMs_t receivedMs) {
     if(isDisplaySelect->getValue()) { // master
-        if(size == sizeof(Trigger)) {
+        if(size > 0 && size % sizeof(Trigger) == 0 && size / sizeof(Trigger) <= SLAVE_TRIGGER_BATCH_MAX) {
             if(lastTimeSync == 0) {
                 return; // cant be synced yet
             }
-            Trigger trigger = *((Trigger*) byteArr);
-            if(!isTriggerValid(trigger)) {
-                uiManager.popup("Station has newer version! Please update all equipment to the newest version!");
-                return;
+            const size_t count = size / sizeof(Trigger);
+            Trigger triggers[SLAVE_TRIGGER_BATCH_MAX];
+            memcpy(triggers, byteArr, size);
+            for (size_t i = 0; i < count; i++) {
+                if(!isTriggerValid(triggers[i])) {
+                    uiManager.popup("Station has newer version! Please update all equipment to the newest version!");
+                    return;
+                }
             }
-            timeMs_t timeVariance = abs(trigger.timeMs - timeMs_t(millis()));
-            if(timeVariance < 15000) {
-                if(!spiffsLogic.triggerInCache(trigger)) {
-                    masterTrigger(trigger);
-                    Serial.printf("Received trigger at %ims (time of receive: %ims)\n", trigger.timeMs, millis());
+            for (size_t i = 0; i < count; i++) {
+                Trigger& trigger = triggers[i];
+                timeMs_t timeVariance = trigger.timeMs - timeMs_t(millis()); // negative for replays from the station outbox
+                if(timeVariance < MASTER_TRIGGER_MAX_AHEAD_MS && -timeVariance < MASTER_TRIGGER_MAX_AGE_MS) {
+                    if(!spiffsLogic.triggerInCache(trigger)) {
+                        masterTrigger(trigger);
+                        Serial.printf("Received trigger at %ims (time of receive: %ims)\n", trigger.timeMs, millis());
+                    } else {
+                        Serial.println("Received already existing trigger");
+                    }
                 } else {
-                    Serial.println("Received already existing trigger");
+                    Serial.printf("Received trigger that was off by %ims. skipping", timeVariance);
                 }
-            } else {
-                Serial.printf("Received trigger that was off by %ims. skipping", timeVariance);
             }
-            sendTrigger(trigger); // copy that
+            sendTriggers(triggers, count); // copy that
         } else {
             Serial.printf("not trigger size: %i!=%i\n", size, sizeof(Trigger));
         }
     } else { // slave
-        if(size == sizeof(Trigger)) { // trigger copy
-            Trigger trigger = *((Trigger*) byteArr);
-            if(slaveTriggers.getSize() > 0 && slaveTriggers.getFirst() == trigger) {
-                Serial.println("Master got my trigger");
-                slaveTriggers.removeIndex(0);
+        if(size > 0 && size % sizeof(Trigger) == 0) { // trigger copy
+            if(size == lastSentSlaveTriggerCount * sizeof(Trigger) && isLastSentSlaveBatch(byteArr)) {
+                slaveBatchAcked();
             }
         } else if(size == sizeof(uint32_t)) { // time sync
-            // if(slaveTriggers.getSize() > 0 && timeSynced) {
+            // if(slaveOutbox.getSize() > 0 && timeSynced) {
             //     Serial.println("Skipped time sync");
             //     return; // only allow time syncs when there are no triggers floating arround 
             // }
-            for (auto &&slaveTrigger : slaveTriggers) { // restoring to local time
-                slaveTrigger.timeMs -= timeSyncOffset;
-            }
             uint32_t masterTime = *((uint32_t*) byteArr);
-            masterTime += radio.getTimeOnAir(sizeof(uint32_t)) / 1000;
+            masterTime += radio.getTimeOnAir(RADIO_FRAME_HEADER_SIZE + sizeof(uint32_t)) / 1000;
             long timeSyncOffsetBefore = timeSyncOffset;
-            timeSyncOffset = timeMs_t(masterTime) - timeMs_t(millis());
+            timeSyncOffset = timeMs_t(masterTime) - receivedMs; // receive time, not processing time
             int32_t variance = timeSyncOffsetBefore - long(timeSyncOffset);
             Serial.printf("Synced time with master. offset: %i, variance: %i\n", timeSyncOffset, variance);
             if(timeSynced && abs(variance) > 1000) { // time was synced before
-                Serial.println("Time sync variance was too big. Assume master has rebooted. Deleting qued triggers");
+                Serial.println("Time sync variance was too big. Assume master has rebooted. Re-basing qued triggers");
                 playSoundNewConnection();
-                slaveTriggers.clear();
             }
-            // for (auto &&slaveTrigger : slaveTriggers) { // applying master time
-            //     slaveTrigger.timeMs += timeSyncOffset;
-            // }
+            slaveOutbox.timeSynced(timeSyncOffset);
             timeSynced = true;
 
             lastTimeSyncMs = millis();
@@ -146,26 +208,27 @@ void handleMasterSlaveLogic() {
     if(isDisplaySelect->getValue()) { // master
         if(millis() - lastTimeSync > 5000) {
             sendTimeSync();
+            sceduleBeacon(); // let joining stations find this network
             lastTimeSync = millis();
         }
     } else { // slave
-        if(timeSynced && slaveTriggers.getSize() > 0 && millis() > nextTriggerSend) {
-            Serial.printf("sceduled triggers: %i\n", slaveTriggers.getSize());
-            Trigger& first = slaveTriggers.getFirst();
-            if(first.timeMs < 0) {
-                Serial.println("removing negative trigger");
-                slaveTriggers.removeIndex(0);
-                return;
+        if(timeSynced && slaveOutbox.getSize() > 0 && millis() > nextTriggerSend) {
+            Serial.printf("sceduled triggers: %i\n", slaveOutbox.getSize());
+            sendSlaveTriggers();
+        }
+        if(millis() - goodputStartMs > GOODPUT_INTERVAL_MS) {
+            slaveGoodput = ackedTriggers * 1000.0 / (millis() - goodputStartMs);
+            if(ackedTriggers > 0) {
+                Serial.printf("Goodput: %.2f triggers/s, window: %i, ack latency: %ims\n", slaveGoodput, slaveSendWindow, ackLatencyMs);
             }
-            sendTrigger(first);
-            timeMs_t triggerTimeout = random(3, 6) * (radio.getTimeOnAir(sizeof(Trigger)) / 1000 + 10);
-            nextTriggerSend = millis() + triggerTimeout;
-            Serial.printf("next trigger timeout: %ims\n", triggerTimeout);
+            ackedTriggers = 0;
+            goodputStartMs = millis();
         }
         if(masterConnected && long(millis()) - long(lastTimeSyncMs) > MASTER_TIMEOUT_MS) {
             masterConnected = false;
             Serial.println("Master disconnected");
             playSoundLostConnection();
         }
+        slaveOutbox.flush();
     }
 }
\ No newline at end of file
@@ -0,0 +1,49 @@
+/**
+ * @file Overlay.h
+ * @brief Drawing of the status line on top of every frame
+ *
+ * Only depends on the display and gui libraries, so render_preview can draw it with the same values msOverlay passes
+ */
+#pragma once
+#include <HT_Display.h>
+#include <gui.h>
+
+/**
+ * @param freeStorage percent. -1 if unknown
+ * @param isDisplaySelect decides between the station line (connection, queued triggers and stationTypeSelect) and the display line (free storage)
+ */
+void drawOverlay(ScreenDisplay *display, int freeStorage, bool masterConnected, size_t outboxSize, Select* isDisplaySelect, Select* stationTypeSelect) {
+  display->setColor(BLACK);
+  display->fillRect(0, 0, 128, 13);
+  display->setColor(WHITE);
+  display->fillRect(7, 13, 114, 1);
+
+  char strConnection[30];
+  strConnection[0] = 0;
+  if(!isDisplaySelect->getValue()) { // slave
+    if(masterConnected) {
+      if(outboxSize > 0) {
+        sprintf(strConnection, "Connected(%i qued)", int(outboxSize));
+      } else {
+        sprintf(strConnection, "Connected");
+      }
+    } else {
+      sprintf(strConnection, "No connection");
+    }
+    display->setFont(ArialMT_Plain_10);
+    display->setTextAlignment(TEXT_ALIGN_LEFT);
+    display->drawString(0, 0, String(strConnection));
+    // type of station
+    display->setTextAlignment(TEXT_ALIGN_RIGHT);
+    display->drawString(128, 0, String(stationTypeSelect->getSelectedShort()));
+  } else {
+    if(freeStorage >= 0) {
+      char memUsedStr[20];
+      memUsedStr[0] = 0;
+      sprintf(memUsedStr, "Free storage: %i%%", freeStorage);
+      display->setFont(ArialMT_Plain_10);
+      display->setTextAlignment(TEXT_ALIGN_LEFT);
+      display->drawString(0, 0, String(memUsedStr));
+    }
+  }
+}
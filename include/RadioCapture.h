@@ -0,0 +1,115 @@
+/**
+ * @file RadioCapture.h
+ * @brief Optional capture of every radio frame into a ring file on flash
+ *
+ * Frames are copied into a queue from the radio paths and written to /capture.bin by the loop.
+ * The file is a fixed ring of RADIO_CAPTURE_SLOTS records. replay_capture.py decodes it and replays it through the master logic
+ */
+#pragma once
+#include <Arduino.h>
+#include <SPIFFS.h>
+#include <esp_timer.h>
+
+#define RADIO_CAPTURE_FILE "/capture.bin"
+#define RADIO_CAPTURE_SLOTS 512 // 28kB
+#define RADIO_CAPTURE_QUEUE_LENGTH 32
+#define RADIO_CAPTURE_DATA_SIZE 40 // RADIO_MAX_FRAME_SIZE at the time of the format. Changing it breaks replay_capture.py
+
+#define RADIO_CAPTURE_TX 1
+#define RADIO_CAPTURE_CRC_ERROR 2
+#define RADIO_CAPTURE_TRUNCATED 4 // frame was larger than data
+
+/**
+ * 56 bytes, no padding. Keep in sync with replay_capture.py
+ */
+struct RadioCaptureRecord {
+  uint32_t seq; // 0 = empty slot
+  uint8_t flags;
+  uint8_t size;
+  int8_t rssi; // dBm
+  int8_t snr; // dB
+  int64_t timeUs; // since boot
+  uint8_t data[RADIO_CAPTURE_DATA_SIZE]; // including the network header
+};
+
+bool radioCaptureEnabled = false;
+QueueHandle_t radioCaptureQueue = nullptr;
+uint32_t radioCaptureSeq = 1;
+volatile uint32_t radioCaptureDropped = 0;
+
+/**
+ * Creates the ring file if needed and continues after the newest record
+ */
+void beginRadioCapture() {
+  if(radioCaptureQueue == nullptr) {
+    radioCaptureQueue = xQueueCreate(RADIO_CAPTURE_QUEUE_LENGTH, sizeof(RadioCaptureRecord));
+  }
+  File file = SPIFFS.open(RADIO_CAPTURE_FILE, FILE_READ, false);
+  if(!file || file.size() != RADIO_CAPTURE_SLOTS * sizeof(RadioCaptureRecord)) {
+    file.close();
+    file = SPIFFS.open(RADIO_CAPTURE_FILE, FILE_WRITE, true);
+    RadioCaptureRecord empty = {};
+    for (size_t i = 0; i < RADIO_CAPTURE_SLOTS; i++) {
+      file.write((uint8_t*) &empty, sizeof(RadioCaptureRecord));
+    }
+    file.close();
+    radioCaptureSeq = 1;
+    Serial.println("Created radio capture");
+    return;
+  }
+  RadioCaptureRecord record;
+  while(file.read((uint8_t*) &record, sizeof(RadioCaptureRecord)) == sizeof(RadioCaptureRecord)) {
+    radioCaptureSeq = max(radioCaptureSeq, record.seq + 1);
+  }
+  file.close();
+}
+
+void setRadioCaptureEnabled(bool enabled) {
+  if(enabled && !radioCaptureEnabled) {
+    beginRadioCapture();
+  }
+  radioCaptureEnabled = enabled;
+}
+
+/**
+ * Allocation free. Safe to call from the receive task
+ */
+void captureRadioFrame(uint8_t flags, const uint8_t* data, size_t size, float rssi, float snr) {
+  if(!radioCaptureEnabled) return;
+  RadioCaptureRecord record;
+  record.seq = 0; // assigned when written
+  record.flags = flags;
+  record.size = min(size, size_t(UINT8_MAX));
+  record.rssi = constrain(rssi, INT8_MIN, INT8_MAX);
+  record.snr = constrain(snr, INT8_MIN, INT8_MAX);
+  record.timeUs = esp_timer_get_time();
+  if(size > RADIO_CAPTURE_DATA_SIZE) {
+    record.flags |= RADIO_CAPTURE_TRUNCATED;
+    size = RADIO_CAPTURE_DATA_SIZE;
+  }
+  memcpy(record.data, data, size);
+  memset(record.data + size, 0, RADIO_CAPTURE_DATA_SIZE - size);
+  if(xQueueSend(radioCaptureQueue, &record, 0) != pdTRUE) {
+    radioCaptureDropped++;
+  }
+}
+
+/**
+ * Writes queued records to flash
+ */
+void handleRadioCapture() {
+  if(radioCaptureQueue == nullptr || uxQueueMessagesWaiting(radioCaptureQueue) == 0) return;
+  File file = SPIFFS.open(RADIO_CAPTURE_FILE, "r+", false);
+  if(!file) {
+    Serial.println("Failed to open radio capture");
+    xQueueReset(radioCaptureQueue);
+    return;
+  }
+  RadioCaptureRecord record;
+  while(xQueueReceive(radioCaptureQueue, &record, 0) == pdTRUE) {
+    record.seq = radioCaptureSeq++;
+    file.seek((record.seq % RADIO_CAPTURE_SLOTS) * sizeof(RadioCaptureRecord));
+    file.write((uint8_t*) &record, sizeof(RadioCaptureRecord));
+  }
+  file.close();
+}
@@ -23,6 +23,8 @@ typedef int64_t timeUs_t;
 
 #define TRIGGERS_PER_PAGE 25
 
+#define SESSION_STATS_CACHE_SUFFIX ".stats" // "<session>.stats" is the cached /stats response of a closed session
+
 struct Trigger {
   timeMs_t timeMs; // overflows after 25 days
   uint16_t millimeters; // maximum is 65.535
@@ -203,6 +205,21 @@ public:
     return file.size();
   }
 
+  /**
+   * Reads up to count triggers from the file, starting at the index'th trigger
+   * @return the number of triggers read
+   */
+  size_t readTriggers(size_t index, Trigger* triggers, size_t count) {
+    File file = SPIFFS.open(filePath, FILE_READ, false);
+    if(!file) return 0;
+    size_t read = 0;
+    if(file.seek(index * sizeof(Trigger))) {
+      read = file.read((uint8_t*) triggers, count * sizeof(Trigger)) / sizeof(Trigger);
+    }
+    file.close();
+    return read;
+  }
+
   /**
    * Assume list is sorted by time
    * Iterate backwards
@@ -470,6 +487,9 @@ public:
     }
     root.close();
     Serial.printf("Found %i session files\n", trainingsMetas.getSize());
+    catalogVersion++;
+    sessionListVersion++;
+    sessionEpoch = esp_random(); // not persisted, so a different epoch than before the reboot
     startNewSession();
     running = true;
     return true;
@@ -486,6 +506,31 @@ public:
     return spiffsVersion == VERSION;
   }
 
+  /**
+   * Changes with every new session and every boot
+   */
+  uint32_t getSessionEpoch() {
+    return sessionEpoch;
+  }
+
+  /**
+   * Changes whenever the session list, or the size of the active session, changes
+   */
+  uint32_t getCatalogVersion() {
+    return catalogVersion;
+  }
+
+  /**
+   * Changes only when sessions are added or deleted, not with every trigger
+   */
+  uint32_t getSessionListVersion() {
+    return sessionListVersion;
+  }
+
+  size_t getActiveSessionSize() {
+    return activeSessionSize;
+  }
+
   size_t getBytesTotal() {
     return SPIFFS.totalBytes();
   }
@@ -497,8 +542,10 @@ public:
   void addTrigger(const Trigger& trigger) {
     if(!running) return;
     activeTraining.addTrigger(trigger);
-    trainingsMetas.get(activeTrainingsIndex).fileSize = activeTraining.getFileSize();
+    activeSessionSize = activeTraining.getFileSize();
+    trainingsMetas.get(activeTrainingsIndex).fileSize = activeSessionSize;
     trainingsMetas.get(activeTrainingsIndex).isRunning = true;
+    catalogVersion++;
   }
 
   bool triggerInCache(const Trigger& trigger) {
@@ -512,7 +559,11 @@ public:
       trainingsMetas.pushBack(TrainingsMeta{ activeTraining.getFileSize(), activeTraining.getFileName(), false });
     }
     activeTraining = TrainingsSession(getFileNameForNewTraining(), true);
-    activeTrainingsIndex = trainingsMetas.pushBack(TrainingsMeta{ activeTraining.getFileSize(), activeTraining.getFileName(), true });
+    activeSessionSize = activeTraining.getFileSize();
+    activeTrainingsIndex = trainingsMetas.pushBack(TrainingsMeta{ activeSessionSize, activeTraining.getFileName(), true });
+    catalogVersion++;
+    sessionListVersion++;
+    sessionEpoch++;
     return true;
   }
 
@@ -539,6 +590,9 @@ public:
     if(!file) return false;
     bool succsess = SPIFFS.remove(file.path());
     if(!succsess) return false;
+    SPIFFS.remove(String("/") + fileName + SESSION_STATS_CACHE_SUFFIX);
+    catalogVersion++;
+    sessionListVersion++;
     size_t i = 0;
     for (auto &&trainingsMeta : trainingsMetas) {
       if(trainingsMeta.fileName == fileName) {
@@ -559,13 +613,15 @@ public:
   void deleteAllSessions() {
     File root = SPIFFS.open("/");
     while(File sessionFile = root.openNextFile()) {
-      if(!String(sessionFile.name()).endsWith(".rt")) {
+      if(!String(sessionFile.name()).endsWith(".rt") && !String(sessionFile.name()).endsWith(SESSION_STATS_CACHE_SUFFIX)) {
         continue;
       }
       bool succsess = SPIFFS.remove(sessionFile.path());
       Serial.printf("Deleting %s/%s succsess: %i\n", sessionFile.path(), String(sessionFile.name()), succsess);
     }
     trainingsMetas.clear();
+    catalogVersion++;
+    sessionListVersion++;
     Serial.println("Deleted all sessions. Updated file system:");
     root.close();
     root = SPIFFS.open("/");
@@ -584,6 +640,10 @@ private:
   DoubleLinkedList<TrainingsMeta> trainingsMetas;
   TrainingsSession activeTraining;
   size_t activeTrainingsIndex;
+  uint32_t catalogVersion = 0;
+  uint32_t sessionListVersion = 0;
+  size_t activeSessionSize = 0;
+  uint32_t sessionEpoch = 0;
 
   static void listFiles(File& dir, uint8_t intends = 0) {
     if(dir.isDirectory()) {
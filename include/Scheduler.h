@@ -0,0 +1,183 @@
+/**
+ * @file Scheduler.h
+ * @brief Cooperative scheduler for loop()
+ *
+ * Every handler is a task with a priority and a period. A task runs when its period is due or when an event it listens to is
+ * raised by an interrupt or another FreeRTOS task. After every task the most important due task is searched again, so trigger and
+ * radio events never wait behind the rest. In between loop() blocks until the next task is due or an event arrives
+ */
+#pragma once
+#include <Arduino.h>
+
+#define SCHEDULER_MAX_TASKS 16
+#define SCHEDULER_MAX_SLEEP_MS 100
+#define SCHEDULER_REPORT_MS 10000 // task statistics on Serial while the debug menu is shown
+
+#define SCHEDULER_EVENT_TRIGGER 0b001 // laser interrupt
+#define SCHEDULER_EVENT_RADIO   0b010 // frame queued by the radio receive task
+#define SCHEDULER_EVENT_INPUT   0b100 // rotary encoder turned
+#define SCHEDULER_EVENT_SOUND  0b1000 // beep started, the buzzer has to follow right away
+
+typedef void (*SchedulerHandler)();
+
+struct SchedulerTask {
+  const char* name;
+  SchedulerHandler handler;
+  uint8_t priority; // 0 runs first
+  uint32_t periodUs; // runs at least this often, events only make it earlier
+  uint32_t events;
+  uint32_t dueUs;
+  // since the last resetSchedulerStats()
+  uint32_t runs;
+  uint64_t totalUs;
+  uint32_t maxUs;
+  uint32_t maxLateUs; // from due or from the event to the start
+};
+
+SchedulerTask schedulerTasks[SCHEDULER_MAX_TASKS]; // by priority
+size_t schedulerTaskCount = 0;
+TaskHandle_t schedulerTaskHandle = nullptr; // the loop task
+portMUX_TYPE schedulerEventMux = portMUX_INITIALIZER_UNLOCKED;
+uint32_t schedulerEvents = 0; // raised since the last look
+uint32_t schedulerEventUs = 0; // when the first of them was raised
+
+/**
+ * @return true if time (micros) is not in the future of nowUs. Correct across the overflow
+ */
+bool isSchedulerDue(uint32_t time, uint32_t nowUs) {
+  return int32_t(nowUs - time) >= 0;
+}
+
+/**
+ * Call from setup(). Tasks of the same priority run in the order they were added
+ */
+void addSchedulerTask(const char* name, SchedulerHandler handler, uint8_t priority, uint32_t periodMs, uint32_t events = 0) {
+  if(schedulerTaskCount == SCHEDULER_MAX_TASKS) {
+    Serial.printf("Scheduler full, %s not added\n", name);
+    return;
+  }
+  schedulerTaskHandle = xTaskGetCurrentTaskHandle();
+  size_t i = schedulerTaskCount++;
+  while(i > 0 && schedulerTasks[i - 1].priority > priority) {
+    schedulerTasks[i] = schedulerTasks[i - 1];
+    i--;
+  }
+  schedulerTasks[i] = SchedulerTask { name, handler, priority, periodMs * 1000, events, micros(), 0, 0, 0, 0 };
+}
+
+ICACHE_RAM_ATTR void wakeSchedulerFromISR(uint32_t events) {
+  if(schedulerTaskHandle == nullptr) return;
+  portENTER_CRITICAL_ISR(&schedulerEventMux);
+  if(schedulerEvents == 0) schedulerEventUs = micros();
+  schedulerEvents |= events;
+  portEXIT_CRITICAL_ISR(&schedulerEventMux);
+  BaseType_t higherPriorityTaskWoken = pdFALSE;
+  vTaskNotifyGiveFromISR(schedulerTaskHandle, &higherPriorityTaskWoken);
+  portYIELD_FROM_ISR(higherPriorityTaskWoken);
+}
+
+/**
+ * From other FreeRTOS tasks or from a handler
+ */
+void wakeScheduler(uint32_t events) {
+  if(schedulerTaskHandle == nullptr) return;
+  portENTER_CRITICAL(&schedulerEventMux);
+  if(schedulerEvents == 0) schedulerEventUs = micros();
+  schedulerEvents |= events;
+  portEXIT_CRITICAL(&schedulerEventMux);
+  if(xTaskGetCurrentTaskHandle() != schedulerTaskHandle) {
+    xTaskNotifyGive(schedulerTaskHandle);
+  }
+}
+
+/**
+ * Loop only. Runs the task of handler at dueUs (micros) if that is before its next period. For handlers with deadlines of their own
+ */
+void setSchedulerTaskDue(SchedulerHandler handler, uint32_t dueUs) {
+  for (size_t i = 0; i < schedulerTaskCount; i++) {
+    SchedulerTask& task = schedulerTasks[i];
+    if(task.handler == handler && !isSchedulerDue(task.dueUs, dueUs)) {
+      task.dueUs = dueUs;
+    }
+  }
+}
+
+/**
+ * Makes the tasks of raised events due at the time of the event
+ */
+void takeSchedulerEvents() {
+  portENTER_CRITICAL(&schedulerEventMux);
+  const uint32_t events = schedulerEvents;
+  const uint32_t eventUs = schedulerEventUs;
+  schedulerEvents = 0;
+  portEXIT_CRITICAL(&schedulerEventMux);
+  if(events == 0) return;
+  for (size_t i = 0; i < schedulerTaskCount; i++) {
+    SchedulerTask& task = schedulerTasks[i];
+    if((task.events & events) && !isSchedulerDue(task.dueUs, eventUs)) {
+      task.dueUs = eventUs;
+    }
+  }
+}
+
+/**
+ * Runs due tasks until none is due, always the most important one first
+ * @return true if at least one task ran
+ */
+bool runDueTasks() {
+  bool ran = false;
+  while(true) {
+    takeSchedulerEvents();
+    const uint32_t nowUs = micros();
+    SchedulerTask* task = nullptr;
+    for (size_t i = 0; i < schedulerTaskCount; i++) {
+      if(isSchedulerDue(schedulerTasks[i].dueUs, nowUs)) {
+        task = &schedulerTasks[i];
+        break;
+      }
+    }
+    if(task == nullptr) return ran;
+    task->maxLateUs = max(task->maxLateUs, nowUs - task->dueUs);
+    task->dueUs = nowUs + task->periodUs;
+    task->handler();
+    const uint32_t runUs = micros() - nowUs;
+    task->runs++;
+    task->totalUs += runUs;
+    task->maxUs = max(task->maxUs, runUs);
+    ran = true;
+  }
+}
+
+/**
+ * Blocks until the next task is due or an event is raised
+ */
+void sleepUntilNextTask() {
+  const uint32_t nowUs = micros();
+  uint32_t sleepUs = SCHEDULER_MAX_SLEEP_MS * 1000;
+  for (size_t i = 0; i < schedulerTaskCount; i++) {
+    if(isSchedulerDue(schedulerTasks[i].dueUs, nowUs)) return;
+    sleepUs = min(sleepUs, schedulerTasks[i].dueUs - nowUs);
+  }
+  const TickType_t ticks = pdMS_TO_TICKS(sleepUs / 1000); // rounded down, the rest is spun in the next pass
+  if(ticks > 0) {
+    ulTaskNotifyTake(pdTRUE, ticks);
+  }
+}
+
+void printSchedulerStats(uint32_t intervalMs) {
+  Serial.printf("Scheduler over %ims: task runs avgUs maxUs maxLateUs load\n", intervalMs);
+  for (size_t i = 0; i < schedulerTaskCount; i++) {
+    const SchedulerTask& task = schedulerTasks[i];
+    Serial.printf("  %-12s %6i %6i %6i %9i %5.1f%%\n", task.name, task.runs, task.runs == 0 ? 0 : uint32_t(task.totalUs / task.runs), task.maxUs,
+        task.maxLateUs, task.totalUs / 10.0 / intervalMs);
+  }
+}
+
+void resetSchedulerStats() {
+  for (size_t i = 0; i < schedulerTaskCount; i++) {
+    schedulerTasks[i].runs = 0;
+    schedulerTasks[i].totalUs = 0;
+    schedulerTasks[i].maxUs = 0;
+    schedulerTasks[i].maxLateUs = 0;
+  }
+}
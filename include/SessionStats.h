@@ -0,0 +1,309 @@
+/**
+ * @file SessionStats.h
+ * @brief Single pass lap analysis of a session file in constant memory
+ *
+ * Follows sessionToLaps() in index.html: laps from start/finish triggers, splits from checkpoints and parcour times.
+ * Laps are handed out as soon as they are complete so they can be streamed. Medians use the P² estimator
+ */
+#pragma once
+#include <Arduino.h>
+#include <algorithm>
+#include <SPIFFSLogic.h>
+
+#define SESSION_STATS_REORDER_WINDOW 16 // late slave triggers are appended out of order
+#define SESSION_STATS_MAX_SPLITS 32 // per lap. Further checkpoints are counted but not listed
+#define SESSION_STATS_MAX_CHECKPOINTS 16
+#define SESSION_STATS_MAX_PARCOUR_STARTS 5 // MAX_PARCOUR_TIMES in the viewer
+
+/**
+ * P² quantile estimator (Jain & Chlamtac). Five markers, no samples stored
+ */
+class P2Quantile {
+private:
+  float p;
+  uint32_t count = 0;
+  float heights[5];
+  float positions[5];
+  float desired[5];
+  float increments[5];
+
+  float parabolic(int i, int d) {
+    return heights[i] + d / (positions[i + 1] - positions[i - 1]) * (
+      (positions[i] - positions[i - 1] + d) * (heights[i + 1] - heights[i]) / (positions[i + 1] - positions[i]) +
+      (positions[i + 1] - positions[i] - d) * (heights[i] - heights[i - 1]) / (positions[i] - positions[i - 1]));
+  }
+
+  float linear(int i, int d) {
+    return heights[i] + d * (heights[i + d] - heights[i]) / (positions[i + d] - positions[i]);
+  }
+
+public:
+  P2Quantile(float p) : p(p) {}
+
+  void add(float x) {
+    if(count < 5) {
+      heights[count++] = x;
+      if(count == 5) {
+        std::sort(heights, heights + 5);
+        for (int i = 0; i < 5; i++) {
+          positions[i] = i + 1;
+        }
+        desired[0] = 1;
+        desired[1] = 1 + 2 * p;
+        desired[2] = 1 + 4 * p;
+        desired[3] = 3 + 2 * p;
+        desired[4] = 5;
+        increments[0] = 0;
+        increments[1] = p / 2;
+        increments[2] = p;
+        increments[3] = (1 + p) / 2;
+        increments[4] = 1;
+      }
+      return;
+    }
+    count++;
+    int k;
+    if(x < heights[0]) {
+      heights[0] = x;
+      k = 0;
+    } else if(x >= heights[4]) {
+      heights[4] = x;
+      k = 3;
+    } else {
+      k = 0;
+      while(x >= heights[k + 1]) k++;
+    }
+    for (int i = k + 1; i < 5; i++) {
+      positions[i]++;
+    }
+    for (int i = 0; i < 5; i++) {
+      desired[i] += increments[i];
+    }
+    for (int i = 1; i < 4; i++) {
+      float delta = desired[i] - positions[i];
+      if((delta >= 1 && positions[i + 1] - positions[i] > 1) || (delta <= -1 && positions[i - 1] - positions[i] < -1)) {
+        int d = delta >= 0 ? 1 : -1;
+        float height = parabolic(i, d);
+        if(heights[i - 1] < height && height < heights[i + 1]) {
+          heights[i] = height;
+        } else {
+          heights[i] = linear(i, d);
+        }
+        positions[i] += d;
+      }
+    }
+  }
+
+  /**
+   * Exact for up to five samples
+   */
+  float get() {
+    if(count == 0) return 0;
+    if(count < 5) {
+      float sorted[5];
+      memcpy(sorted, heights, count * sizeof(float));
+      std::sort(sorted, sorted + count);
+      return sorted[min(uint32_t(p * count), count - 1)];
+    }
+    return heights[2];
+  }
+};
+
+struct TimeStats {
+  uint32_t count = 0;
+  timeMs_t best = 0;
+  int64_t sum = 0;
+  P2Quantile median = P2Quantile(0.5);
+
+  void add(timeMs_t timeMs) {
+    best = count == 0 ? timeMs : min(best, timeMs);
+    count++;
+    sum += timeMs;
+    median.add(timeMs);
+  }
+
+  timeMs_t avg() {
+    return count == 0 ? 0 : timeMs_t(sum / count);
+  }
+};
+
+/**
+ * Average and best speed of passes with a known distance
+ */
+struct SpeedStats {
+  int64_t millimeters = 0;
+  int64_t timeMs = 0;
+  float bestKmh = 0;
+
+  void add(uint16_t passMillimeters, timeMs_t passTimeMs) {
+    if(passMillimeters == 0 || passTimeMs <= 0) return;
+    millimeters += passMillimeters;
+    timeMs += passTimeMs;
+    bestKmh = max(bestKmh, float(passMillimeters) / float(passTimeMs) * 3.6f);
+  }
+
+  float avgKmh() {
+    return timeMs == 0 ? 0 : float(millimeters) / float(timeMs) * 3.6f;
+  }
+};
+
+struct StatsSplit {
+  timeMs_t timeMs; // since the lap start
+  uint16_t millimeters;
+  uint8_t index;
+  bool isFinish;
+};
+
+struct StatsLap {
+  uint32_t index;
+  timeMs_t timeMs;
+  uint16_t millimeters; // of the finish trigger
+  bool done;
+  bool parcour;
+  uint8_t splitCount;
+  StatsSplit splits[SESSION_STATS_MAX_SPLITS];
+};
+
+struct CheckpointStats {
+  uint16_t millimeters = 0;
+  TimeStats times;
+};
+
+class SessionAnalyser {
+private:
+  Trigger window[SESSION_STATS_REORDER_WINDOW]; // sorted by time
+  size_t windowSize = 0;
+
+  StatsLap current;
+  bool lapStarted = false;
+  bool finishPending = false;
+  timeMs_t lapStart = 0;
+  timeMs_t lastPass = 0;
+  int32_t lastMillimeters = -1;
+  uint8_t currentCheckpoint = 0;
+  uint32_t lapCount = 0;
+  timeMs_t parcourStarts[SESSION_STATS_MAX_PARCOUR_STARTS];
+  size_t parcourStartCount = 0;
+
+  void resetCurrent() {
+    current.splitCount = 0;
+  }
+
+  void addSplit(uint16_t millimeters, timeMs_t timeMs, bool isFinish) {
+    if(!isFinish && currentCheckpoint < SESSION_STATS_MAX_CHECKPOINTS) {
+      checkpoints[currentCheckpoint].millimeters = millimeters;
+      checkpoints[currentCheckpoint].times.add(timeMs);
+      checkpointCount = max(checkpointCount, size_t(currentCheckpoint + 1));
+    }
+    if(current.splitCount < SESSION_STATS_MAX_SPLITS) {
+      current.splits[current.splitCount++] = StatsSplit { timeMs, millimeters, currentCheckpoint, isFinish };
+    }
+    currentCheckpoint++;
+  }
+
+  template<typename LapCallback>
+  void process(const Trigger& trigger, LapCallback onLap) {
+    const uint8_t type = trigger.triggerType;
+    const bool isStart = type == STATION_TRIGGER_TYPE_START || type == STATION_TRIGGER_TYPE_START_FINISH;
+    if(lapStarted && (type == STATION_TRIGGER_TYPE_FINISH || type == STATION_TRIGGER_TYPE_START_FINISH)) {
+      if(current.splitCount > 0) {
+        addSplit(trigger.millimeters, trigger.timeMs - lastPass, true);
+      }
+      current.index = lapCount++;
+      current.timeMs = trigger.timeMs - lapStart;
+      current.millimeters = trigger.millimeters;
+      current.done = true;
+      current.parcour = false;
+      laps.add(current.timeMs);
+      lapSpeeds.add(current.millimeters, current.timeMs);
+      onLap(current);
+      resetCurrent();
+      lapStarted = false;
+      finishPending = false;
+    }
+    if(isStart) {
+      lapStart = trigger.timeMs;
+      lastMillimeters = -1;
+      lapStarted = true;
+      currentCheckpoint = 0;
+    }
+    if(type == STATION_TRIGGER_TYPE_START) {
+      finishPending = true;
+    }
+    if(lapStarted && type == STATION_TRIGGER_TYPE_CHECKPOINT) {
+      if(trigger.millimeters <= lastMillimeters) return;
+      addSplit(trigger.millimeters, trigger.timeMs - lastPass, false);
+      lastMillimeters = trigger.millimeters;
+      finishPending = true;
+    }
+    if(isStart) {
+      lastPass = trigger.timeMs;
+    }
+    if(type == STATION_TRIGGER_TYPE_PARCOUR_START && parcourStartCount < SESSION_STATS_MAX_PARCOUR_STARTS) {
+      parcourStarts[parcourStartCount++] = trigger.timeMs;
+    }
+    if(type == STATION_TRIGGER_TYPE_PARCOUR_FINISH && parcourStartCount > 0) {
+      StatsLap lap;
+      lap.index = lapCount++;
+      lap.timeMs = trigger.timeMs - parcourStarts[0];
+      lap.millimeters = trigger.millimeters;
+      lap.done = true;
+      lap.parcour = true;
+      lap.splitCount = 0;
+      memmove(parcourStarts, parcourStarts + 1, (--parcourStartCount) * sizeof(timeMs_t));
+      parcour.add(lap.timeMs);
+      parcourSpeeds.add(lap.millimeters, lap.timeMs);
+      onLap(lap);
+    }
+  }
+
+public:
+  TimeStats laps;
+  SpeedStats lapSpeeds;
+  TimeStats parcour;
+  SpeedStats parcourSpeeds;
+  CheckpointStats checkpoints[SESSION_STATS_MAX_CHECKPOINTS];
+  size_t checkpointCount = 0;
+
+  SessionAnalyser() {
+    resetCurrent();
+  }
+
+  /**
+   * Triggers in file order. onLap(const StatsLap&) is called for every completed lap
+   */
+  template<typename LapCallback>
+  void add(const Trigger& trigger, LapCallback onLap) {
+    if(windowSize == SESSION_STATS_REORDER_WINDOW) {
+      process(window[0], onLap);
+      memmove(window, window + 1, (--windowSize) * sizeof(Trigger));
+    }
+    size_t i = windowSize++;
+    while(i > 0 && window[i - 1].timeMs > trigger.timeMs) {
+      window[i] = window[i - 1];
+      i--;
+    }
+    window[i] = trigger;
+  }
+
+  /**
+   * Processes the rest of the window. A lap still running is handed out with done = false
+   */
+  template<typename LapCallback>
+  void finish(LapCallback onLap) {
+    for (size_t i = 0; i < windowSize; i++) {
+      process(window[i], onLap);
+    }
+    windowSize = 0;
+    if(current.splitCount > 0 || finishPending) {
+      current.index = lapCount;
+      current.timeMs = 0;
+      current.millimeters = 0;
+      current.done = false;
+      current.parcour = false;
+      onLap(current);
+      resetCurrent();
+      finishPending = false;
+    }
+  }
+};
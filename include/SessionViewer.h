@@ -0,0 +1,194 @@
+/**
+ * @file SessionViewer.h
+ * @brief Rows of the on-device session viewer, computed on demand from the session file
+ *
+ * Rows follow the old updateViewer(): one per checkpoint and per finished lap, newest first, and "Running..." while a lap without
+ * checkpoints is running. Only resume points into the file are kept in RAM, so reading any row costs one seek and a short parse
+ */
+#pragma once
+#include <Arduino.h>
+#include <SPIFFSLogic.h>
+
+#define VIEWER_RESUME_POINTS 64
+#define VIEWER_RESUME_STRIDE 16 // triggers between resume points at first. Doubled whenever the resume points run out
+#define VIEWER_READ_CHUNK 16 // triggers read from the file at once
+
+#define VIEWER_ROW_RUNNING 0
+#define VIEWER_ROW_CHECKPOINT 1
+#define VIEWER_ROW_LAP 2
+
+struct ViewerRow {
+  uint8_t type;
+  uint8_t triggerType; // checkpoint rows of a finish have no distance
+  uint16_t millimeters;
+  uint32_t number; // 1 based lap or checkpoint number
+  timeMs_t timeMs;
+};
+
+/**
+ * Parser state in front of a trigger. Parsing can be resumed from here
+ */
+struct ViewerResumePoint {
+  uint32_t trigger;
+  uint32_t row; // rows produced before this trigger
+  timeMs_t lapStart;
+  timeMs_t lastTrigger;
+  int32_t lastMillimeters;
+  uint32_t lapCount;
+  uint16_t currentCheckpoint;
+  bool lapStarted;
+  bool checkpointPassed;
+};
+
+class SessionViewer {
+private:
+  String fileName;
+  ViewerResumePoint resumePoints[VIEWER_RESUME_POINTS]; // every stride triggers
+  size_t resumePointCount = 0;
+  uint32_t stride = VIEWER_RESUME_STRIDE;
+  ViewerResumePoint tail; // behind the last indexed trigger
+
+  static void resetState(ViewerResumePoint& state) {
+    state = ViewerResumePoint { 0, 0, 0, 0, -1, 1, 0, false, false };
+  }
+
+  /**
+   * Advances state over one trigger. onRow(const ViewerRow&) gets the rows it produces in file order
+   */
+  template<typename RowCallback>
+  static void step(ViewerResumePoint& state, const Trigger& t, RowCallback onRow) {
+    state.trigger++;
+    if(state.lapStarted && (t.triggerType == STATION_TRIGGER_TYPE_FINISH || t.triggerType == STATION_TRIGGER_TYPE_START_FINISH)) {
+      if(state.checkpointPassed) {
+        onRow(ViewerRow { VIEWER_ROW_CHECKPOINT, t.triggerType, t.millimeters, uint32_t(state.currentCheckpoint + 1), t.timeMs - state.lastTrigger });
+        state.row++;
+      }
+      onRow(ViewerRow { VIEWER_ROW_LAP, t.triggerType, t.millimeters, state.lapCount, t.timeMs - state.lapStart });
+      state.row++;
+      state.lapStarted = false;
+      state.lapCount++;
+    }
+    if(t.triggerType == STATION_TRIGGER_TYPE_START || t.triggerType == STATION_TRIGGER_TYPE_START_FINISH) {
+      state.lapStart = t.timeMs;
+      state.lastTrigger = t.timeMs;
+      state.lastMillimeters = -1;
+      state.checkpointPassed = false;
+      state.lapStarted = true;
+      state.currentCheckpoint = 0;
+    }
+    if(state.lapStarted && t.triggerType == STATION_TRIGGER_TYPE_CHECKPOINT) {
+      if(int32_t(t.millimeters) <= state.lastMillimeters) return;
+      onRow(ViewerRow { VIEWER_ROW_CHECKPOINT, t.triggerType, t.millimeters, uint32_t(state.currentCheckpoint + 1), t.timeMs - state.lastTrigger });
+      state.row++;
+      state.lastMillimeters = t.millimeters;
+      state.lastTrigger = t.timeMs;
+      state.checkpointPassed = true;
+      state.currentCheckpoint++;
+    }
+  }
+
+  void addResumePoint(const ViewerResumePoint& point) {
+    if(resumePointCount == VIEWER_RESUME_POINTS) { // keep every second one
+      for (size_t i = 0; i < VIEWER_RESUME_POINTS / 2; i++) {
+        resumePoints[i] = resumePoints[i * 2];
+      }
+      resumePointCount = VIEWER_RESUME_POINTS / 2;
+      stride *= 2;
+      if(point.trigger % stride != 0) return;
+    }
+    resumePoints[resumePointCount++] = point;
+  }
+
+  bool isRunning() {
+    return tail.lapStarted && !tail.checkpointPassed;
+  }
+
+public:
+  SessionViewer() {
+    resetState(tail);
+  }
+
+  /**
+   * Indexes the triggers added since the last call. Starts over if session is a different session
+   * @return true if the rows changed
+   */
+  bool update(TrainingsSession& session) {
+    bool changed = false;
+    if(session.getFileName() != fileName) {
+      fileName = session.getFileName();
+      resumePointCount = 0;
+      stride = VIEWER_RESUME_STRIDE;
+      resetState(tail);
+      changed = true;
+    }
+    const size_t triggerCount = session.getTriggerCount();
+    Trigger triggers[VIEWER_READ_CHUNK];
+    while(tail.trigger < triggerCount) {
+      size_t read = session.readTriggers(tail.trigger, triggers, min(size_t(VIEWER_READ_CHUNK), triggerCount - tail.trigger));
+      if(read == 0) break;
+      for (size_t i = 0; i < read; i++) {
+        if(tail.trigger % stride == 0) {
+          addResumePoint(tail);
+        }
+        step(tail, triggers[i], [](const ViewerRow& row) {});
+      }
+      changed = true;
+    }
+    return changed;
+  }
+
+  size_t getRowCount() {
+    return tail.row + (isRunning() ? 1 : 0);
+  }
+
+  /**
+   * Rows first to first + count - 1, newest first. Reads the file from the closest resume point on
+   * @return the number of rows written
+   */
+  size_t getRows(TrainingsSession& session, size_t first, size_t count, ViewerRow* rows) {
+    const size_t rowCount = getRowCount();
+    if(first >= rowCount) return 0;
+    count = min(count, rowCount - first);
+    size_t filled = 0;
+    if(isRunning()) {
+      if(first == 0) {
+        rows[filled++] = ViewerRow { VIEWER_ROW_RUNNING, 0, 0, tail.lapCount, 0 };
+      } else {
+        first--;
+      }
+    }
+    if(filled == count) return filled;
+    // file rows hi down to lo
+    const uint32_t hi = tail.row - 1 - first;
+    const uint32_t lo = hi + 1 - (count - filled);
+    // last resume point in front of row lo
+    size_t left = 0;
+    size_t right = resumePointCount;
+    while(right - left > 1) {
+      size_t middle = (left + right) / 2;
+      if(resumePoints[middle].row <= lo) {
+        left = middle;
+      } else {
+        right = middle;
+      }
+    }
+    ViewerResumePoint state = resumePoints[left];
+    ViewerRow* target = rows + filled;
+    Trigger triggers[VIEWER_READ_CHUNK];
+    while(state.row <= hi && state.trigger < tail.trigger) {
+      size_t read = session.readTriggers(state.trigger, triggers, min(size_t(VIEWER_READ_CHUNK), size_t(tail.trigger - state.trigger)));
+      if(read == 0) break;
+      for (size_t i = 0; i < read && state.row <= hi; i++) {
+        step(state, triggers[i], [&](const ViewerRow& row) {
+          if(state.row >= lo && state.row <= hi) {
+            target[hi - state.row] = row;
+          }
+        });
+      }
+    }
+    if(state.row <= hi) { // file could not be read
+      return filled;
+    }
+    return count;
+  }
+};
@@ -0,0 +1,163 @@
+/**
+ * @file SlaveOutbox.h
+ * @brief Flash backed queue of station triggers that have not been acknowledged by the master yet
+ *
+ * Triggers are kept in local clock form and converted to master time right before sending.
+ * The file is a fixed ring of slots. A slot is retired once the master copied the trigger.
+ * All flash access happens in flush() so adding a trigger never touches flash.
+ */
+#pragma once
+#include <Arduino.h>
+#include <SPIFFS.h>
+#include <SPIFFSLogic.h>
+#include <DoubleLinkedList.h>
+
+#define OUTBOX_FILE "/outbox.bin"
+#define OUTBOX_SLOTS 64
+
+#define OUTBOX_FLAG_SYNCED 1 // syncOffset is valid
+#define OUTBOX_FLAG_RETIRED 2
+#define OUTBOX_FLAG_DIRTY 4 // ram only. Needs to be written
+
+struct OutboxRecord {
+  uint32_t seq; // 0 = empty slot
+  uint32_t bootId;
+  timeMs_t localMs;
+  timeMs_t syncOffset; // master - local of the boot this trigger was taken in
+  uint16_t millimeters;
+  uint8_t triggerType;
+  uint8_t flags;
+};
+
+bool sortCompareOutboxRecords(const OutboxRecord& a, const OutboxRecord& b) {
+  return a.seq < b.seq;
+}
+
+class SlaveOutbox {
+private:
+  DoubleLinkedList<OutboxRecord> pending;
+  DoubleLinkedList<OutboxRecord> retired; // waiting to be written
+  uint32_t nextSeq = 1;
+  uint32_t bootId = 1;
+  bool dirty = false;
+  bool synced = false; // this boot got a time sync
+  timeMs_t syncOffset = 0; // of the last time sync
+
+  static size_t slotOffset(uint32_t seq) {
+    return (seq % OUTBOX_SLOTS) * sizeof(OutboxRecord);
+  }
+
+  void retire(OutboxRecord record) {
+    record.flags = (record.flags | OUTBOX_FLAG_RETIRED) & ~OUTBOX_FLAG_DIRTY;
+    retired.pushBack(record);
+    dirty = true;
+  }
+
+public:
+  /**
+   * Loads unacknowledged triggers of previous boots. Triggers taken before any time sync can't be re-based anymore and are dropped
+   */
+  void begin() {
+    File file = SPIFFS.open(OUTBOX_FILE, FILE_READ, false);
+    if(!file || file.size() != OUTBOX_SLOTS * sizeof(OutboxRecord)) {
+      file.close();
+      file = SPIFFS.open(OUTBOX_FILE, FILE_WRITE, true);
+      OutboxRecord empty = {};
+      for (size_t i = 0; i < OUTBOX_SLOTS; i++) {
+        file.write((uint8_t*) &empty, sizeof(OutboxRecord));
+      }
+      file.close();
+      Serial.println("Created outbox");
+      return;
+    }
+    OutboxRecord record;
+    uint32_t lastBootId = 0;
+    while(file.read((uint8_t*) &record, sizeof(OutboxRecord)) == sizeof(OutboxRecord)) {
+      if(record.seq == 0) continue;
+      nextSeq = max(nextSeq, record.seq + 1);
+      lastBootId = max(lastBootId, record.bootId);
+      if(record.flags & OUTBOX_FLAG_RETIRED) continue;
+      if(record.flags & OUTBOX_FLAG_SYNCED) {
+        pending.pushBack(record);
+      } else {
+        retire(record);
+      }
+    }
+    file.close();
+    bootId = lastBootId + 1;
+    pending.sort(sortCompareOutboxRecords);
+    Serial.printf("Outbox restored %i triggers, dropped %i unsynced\n", pending.getSize(), retired.getSize());
+  }
+
+  /**
+   * RAM only. Call flush() from the loop to persist. After a time sync the trigger is stamped with its offset right away,
+   * so it survives a reboot even if the master is gone by then
+   */
+  void add(timeMs_t localMs, uint8_t triggerType, uint16_t millimeters) {
+    if(pending.getSize() >= OUTBOX_SLOTS) {
+      Serial.println("Outbox full. Dropping oldest trigger");
+      pending.removeIndex(0); // its slot is overwritten by this one
+    }
+    OutboxRecord record = { nextSeq++, bootId, localMs, syncOffset, millimeters, triggerType, uint8_t(OUTBOX_FLAG_DIRTY | (synced ? OUTBOX_FLAG_SYNCED : 0)) };
+    pending.pushBack(record);
+    dirty = true;
+  }
+
+  /**
+   * Remembers the offset so triggers of this boot can still be re-based after a reboot
+   */
+  void timeSynced(timeMs_t syncOffset) {
+    this->synced = true;
+    this->syncOffset = syncOffset;
+    for (auto &&record : pending) {
+      if(record.bootId == bootId && !(record.flags & OUTBOX_FLAG_SYNCED)) {
+        record.syncOffset = syncOffset;
+        record.flags |= OUTBOX_FLAG_SYNCED | OUTBOX_FLAG_DIRTY;
+        dirty = true;
+      }
+    }
+  }
+
+  size_t getSize() {
+    return pending.getSize();
+  }
+
+  /**
+   * A queued trigger in master time. Triggers of earlier boots use the offset stored with them
+   */
+  Trigger get(size_t index, timeMs_t syncOffset) {
+    OutboxRecord& record = pending.get(index);
+    timeMs_t offset = record.bootId == bootId ? syncOffset : record.syncOffset;
+    return Trigger { record.localMs + offset, record.millimeters, record.triggerType };
+  }
+
+  void retireFirst() {
+    if(pending.getSize() == 0) return;
+    retire(pending.getFirst());
+    pending.removeIndex(0);
+  }
+
+  void flush() {
+    if(!dirty) return;
+    dirty = false;
+    File file = SPIFFS.open(OUTBOX_FILE, "r+", false);
+    if(!file) {
+      Serial.println("Failed to open outbox");
+      return;
+    }
+    for (auto &&record : retired) {
+      file.seek(slotOffset(record.seq));
+      file.write((uint8_t*) &record, sizeof(OutboxRecord));
+    }
+    retired.clear();
+    for (auto &&record : pending) {
+      if(!(record.flags & OUTBOX_FLAG_DIRTY)) continue;
+      record.flags &= ~OUTBOX_FLAG_DIRTY;
+      file.seek(slotOffset(record.seq));
+      file.write((uint8_t*) &record, sizeof(OutboxRecord));
+    }
+    file.close();
+  }
+};
+
+SlaveOutbox slaveOutbox;
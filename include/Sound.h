@@ -11,6 +11,7 @@
 #pragma once
 #include <Arduino.h>
 #include <Global.h>
+#include <Scheduler.h>
 
 struct Beep {
 
@@ -39,6 +40,7 @@ struct Beep {
         //     1 		// The number of cycle.
         // );
         EasyBuzzer.beep(frequency, onDuration, offDuration, beeps, 100, 1);
+        wakeScheduler(SCHEDULER_EVENT_SOUND);
         return millis() + getFullDuration();
     }
 };
@@ -61,6 +63,7 @@ void playSound(Sound sound) {
     if(sound.beepsSize == 0) return;
     currentSound = sound;
     nextBeep = millis();
+    wakeScheduler(SCHEDULER_EVENT_SOUND);
 }
 
 void beginSounds() {
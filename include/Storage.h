@@ -15,11 +15,13 @@
 #include <GuiLogic.h>
 #include <WiFiLogic.h>
 
-#define STORAGE_CHECK 20004 // count up by one if any changes were made in this file
+#define STORAGE_CHECK 20006 // count up by one if any changes were made in this file
 
 Preferences preferences;
 
 void isDisplayChanged();
+void applyRadioNetwork(uint8_t network);
+void setRadioCaptureEnabled(bool enabled);
 // void wifiEnabledChanged();
 
 void writePreferences() {
@@ -27,6 +29,7 @@ void writePreferences() {
   // preferences.putDouble("startDist", distFromStartInput->getValue());
   preferences.putDouble("minDelay", minDelayInput->getValue());
   preferences.putDouble("brightness", displayBrightnessInput->getValue());
+  preferences.putDouble("batteryLife", batteryLifeInput->getValue());
   preferences.putDouble("dispLapTime", displayTimeInput->getValue());
   preferences.putInt("isDisplay", isDisplaySelect->getValue());
   preferences.putInt("trainingsMode", trainingsModeSelect->getValue());
@@ -40,6 +43,8 @@ void writePreferences() {
   preferences.putString("APSsid", APSsid);
   preferences.putString("APPassword", APPassword);
   preferences.putInt("lapDisplayType", lapDisplayTypeSelect->getValue());
+  preferences.putInt("radioNetwork", radioNetwork);
+  preferences.putBool("radioCapture", radioCaptureCB->isChecked());
 }
 
 void readPreferences() {
@@ -47,6 +52,7 @@ void readPreferences() {
   // distFromStartInput->setValue(preferences.getDouble("startDist"));
   minDelayInput->setValue(preferences.getDouble("minDelay"));
   displayBrightnessInput->setValue(preferences.getDouble("brightness"));
+  batteryLifeInput->setValue(preferences.getDouble("batteryLife", LED_BATTERY_LIFE_DEFAULT_H));
   displayTimeInput->setValue(preferences.getDouble("dispLapTime"));
   isDisplaySelect->setValue(preferences.getInt("isDisplay"));
   trainingsModeSelect->setValue(preferences.getInt("trainingsMode"));
@@ -57,6 +63,10 @@ void readPreferences() {
   uploadWifiPassword = preferences.getString("wifiPassword");
   username = preferences.getString("username");
   lapDisplayTypeSelect->setValue(preferences.getInt("lapDisplayType"));
+  radioNetworkInput->setValue(preferences.getInt("radioNetwork") + 1);
+  applyRadioNetwork(preferences.getInt("radioNetwork"));
+  radioCaptureCB->setChecked(preferences.getBool("radioCapture"));
+  setRadioCaptureEnabled(radioCaptureCB->isChecked());
   // if(isDisplaySelect->getValue()) { // only activate wifi if this is a display
   //   wifiEnabledCB->setChecked(preferences.getBool("wifiOn"), false);
   //   wifiEnabledChanged();
@@ -75,6 +85,7 @@ void resetAllSettings() {
   distFromStartInput->setValue(30);
   minDelayInput->setValue(1);
   displayBrightnessInput->setValue(10);
+  batteryLifeInput->setValue(LED_BATTERY_LIFE_DEFAULT_H);
   displayTimeInput->setValue(7);
   trainingsModeSelect->setValue(TRAININGS_MODE_NORMAL);
   stationTypeSelect->setValue(STATION_TRIGGER_TYPE_START_FINISH);
@@ -86,6 +97,9 @@ void resetAllSettings() {
   APSsid = APSSID_DISPLAY_DEFAULT;
   APPassword = APPASSWORD_DEFAULT;
   lapDisplayTypeSelect->setValue(0); // lap time mode
+  radioNetwork = RADIO_NETWORK_JOIN;
+  radioNetworkInput->setValue(RADIO_NETWORK_JOIN + 1);
+  radioCaptureCB->setChecked(false);
   // wifiEnabledCB->setChecked(true);
   // determine if this is a display or laser by checking if PIN_LASER is floating
   // u8_t floatingCount = 0;
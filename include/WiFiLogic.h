@@ -18,8 +18,11 @@
 #include <SPIFFS.h>
 #include <JsonBuilder.h>
 #include <SPIFFSLogic.h>
+#include <RadioCapture.h>
+#include <SessionStats.h>
 #include <HTTPClient.h>
 #include <Update.h>
+#include <rom/crc.h>
 #include <Storage.h>
 #include <GuiLogic.h>
 
@@ -34,6 +37,7 @@ String APPassword = APPASSWORD_DEFAULT;
 AsyncWebServer server(80);
 
 AsyncEventSource liveEventHandler("/live");
+AsyncWebSocket controlSocket("/control");
 
 // const byte DNS_PORT = 53;
 
@@ -53,70 +57,455 @@ void handleIndexPage(AsyncWebServerRequest* request);
 void handleNotFound(AsyncWebServerRequest* request);
 void handleSessionsJson(AsyncWebServerRequest* request);
 void handleSession(AsyncWebServerRequest* request);
+void handleSessionBin(AsyncWebServerRequest* request);
+void handleStats(AsyncWebServerRequest* request);
 void handleCaptive(AsyncWebServerRequest* request);
-void handleInPositionMp3(AsyncWebServerRequest* request);
-void handleSetMp3(AsyncWebServerRequest* request);
-void handleBeepMp3(AsyncWebServerRequest* request);
+void handleStaticAsset(AsyncWebServerRequest* request);
 void handleStartIn(AsyncWebServerRequest* request);
 void handleSettings(AsyncWebServerRequest* request);
 void handleDeleteSession(AsyncWebServerRequest* request);
-void handleLogo(AsyncWebServerRequest* request);
-void handleUserManual(AsyncWebServerRequest* request);
 void handleWiFiSettings(AsyncWebServerRequest* request);
 void handleUpdatePage(AsyncWebServerRequest* request);
-DoubleLinkedList<SessionPageInfo> buildSessionTriggers(JsonBuilder& builder, TrainingsSession& session, size_t page);
+void handleRadioCaptureDownload(AsyncWebServerRequest* request);
+
+/**
+ * Appends the next piece of a streamed JSON document to the builder. Returns false after the last piece
+ */
+typedef std::function<bool(JsonBuilder& builder)> JsonPieceGenerator;
 
 void beginWiFi();
 // void endWiFi();
 void writePreferences();
 void wiFiCredentialsChanged();
 
-// ?
-String processor(const String& var) {
-  return String();
+#define JSON_TRIGGERS_PER_PIECE 8
+#define JSON_STREAM_PIECE_RESERVE 512 // pieces are built in place after the first one
+
+/**
+ * Sends a chunked JSON response that is generated piece by piece while the TCP buffer drains.
+ * Only one piece is held in ram at a time, whatever the size of the whole document
+ * @param cachePath if set, the document is also written to this file. It only appears once complete
+ */
+void sendJsonStream(AsyncWebServerRequest* request, JsonPieceGenerator nextPiece, const String& cachePath = String()) {
+    struct JsonStreamState {
+        JsonBuilder builder;
+        size_t offset = 0; // already sent part of the current piece
+        bool done = false;
+        JsonPieceGenerator nextPiece;
+        String cachePath;
+        File cacheFile;
+    };
+    std::shared_ptr<JsonStreamState> state = std::make_shared<JsonStreamState>();
+    state->nextPiece = nextPiece;
+    state->builder.reserve(JSON_STREAM_PIECE_RESERVE);
+    if(cachePath.length() > 0) {
+        state->cachePath = cachePath;
+        state->cacheFile = SPIFFS.open(cachePath + ".tmp", FILE_WRITE, true);
+    }
+    AsyncWebServerResponse* response = request->beginChunkedResponse("application/json", [state](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+        size_t written = 0;
+        while(written < maxLen) {
+            if(state->offset >= state->builder.length()) {
+                if(state->done) break;
+                state->builder.clearJson();
+                state->offset = 0;
+                state->done = !state->nextPiece(state->builder);
+                if(state->cacheFile) {
+                    state->cacheFile.write((const uint8_t*) state->builder.c_str(), state->builder.length());
+                    if(state->done) {
+                        state->cacheFile.close();
+                        SPIFFS.rename(state->cachePath + ".tmp", state->cachePath);
+                    }
+                }
+                continue;
+            }
+            size_t n = min(maxLen - written, state->builder.length() - state->offset);
+            memcpy(buffer + written, state->builder.c_str() + state->offset, n);
+            written += n;
+            state->offset += n;
+        }
+        return written;
+    });
+    request->send(response);
+}
+
+#define CACHE_CONTROL_REVALIDATE "no-cache" // may change with every spiffs update. Answered with 304 while unchanged
+#define CACHE_CONTROL_LONG "public, max-age=604800"
+
+/**
+ * Files served from SPIFFS. "<path>.gz" (made by compress_data.py) is preferred over the plain file for clients accepting gzip
+ */
+struct StaticAsset {
+    const char* url;
+    const char* path;
+    const char* contentType;
+    const char* cacheControl;
+    String etag; // crc32 of the plain file. Empty if there is none
+    String gzipEtag; // crc32 of "<path>.gz". Empty if there is none
+};
+
+StaticAsset staticAssets[] = {
+    { "/index.html", "/index.html", "text/html", CACHE_CONTROL_REVALIDATE },
+    { "/user-manual.html", "/user-manual.html", "text/html", CACHE_CONTROL_REVALIDATE },
+    { "/logo.png", "/logo.png", "image/png", CACHE_CONTROL_LONG },
+    { "/inPosition.mp3", "/inPosition.mp3", "audio/mpeg", CACHE_CONTROL_LONG },
+    { "/set.mp3", "/set.mp3", "audio/mpeg", CACHE_CONTROL_LONG },
+    { "/beep.mp3", "/beep.mp3", "audio/mpeg", CACHE_CONTROL_LONG },
+    { "/notFound.html", "/notFound.html", "text/html", CACHE_CONTROL_REVALIDATE },
+    { "/captive.html", "/captive.html", "text/html", CACHE_CONTROL_REVALIDATE },
+};
+
+/**
+ * @return quoted crc32 of the file, empty if it doesnt exist
+ */
+String fileETag(const String& path) {
+    File file = SPIFFS.open(path, FILE_READ, false);
+    if(!file) return String();
+    uint8_t buffer[512];
+    uint32_t crc = 0;
+    size_t read;
+    while((read = file.read(buffer, sizeof(buffer))) > 0) {
+        crc = crc32_le(crc, buffer, read);
+    }
+    file.close();
+    char etag[12];
+    sprintf(etag, "\"%08x\"", (unsigned int) crc);
+    return etag;
+}
+
+/**
+ * Hashes every asset once so requests only have to compare ETags
+ * @note Blocking. Reads all assets once
+ */
+void beginStaticAssets() {
+    for (StaticAsset& asset : staticAssets) {
+        asset.etag = fileETag(asset.path);
+        asset.gzipEtag = fileETag(String(asset.path) + ".gz");
+    }
+}
+
+/**
+ * @return false if Accept-Encoding doesnt list gzip or gives it q=0
+ */
+bool acceptsGzip(AsyncWebServerRequest* request) {
+    if(!request->hasHeader("Accept-Encoding")) return false;
+    String acceptEncoding = request->header("Accept-Encoding");
+    int gzip = acceptEncoding.indexOf("gzip");
+    if(gzip < 0) return false;
+    int end = acceptEncoding.indexOf(',', gzip);
+    String params = acceptEncoding.substring(gzip + 4, end < 0 ? acceptEncoding.length() : end);
+    int q = params.indexOf("q=");
+    return q < 0 || params.substring(q + 2).toFloat() > 0;
+}
+
+void sendStaticAsset(AsyncWebServerRequest* request, StaticAsset& asset) {
+    const bool gzip = asset.gzipEtag.length() > 0 && acceptsGzip(request);
+    const String& etag = gzip ? asset.gzipEtag : asset.etag;
+    if(etag.length() == 0) {
+        if(asset.gzipEtag.length() > 0) {
+            request->send(406, "text/plain", "Only available gzip encoded");
+        } else {
+            request->send(404, "text/plain", "Not found");
+        }
+        return;
+    }
+    AsyncWebServerResponse* response;
+    if(request->hasHeader("If-None-Match") && request->header("If-None-Match") == etag) {
+        response = request->beginResponse(304);
+    } else {
+        response = request->beginResponse(SPIFFS, gzip ? String(asset.path) + ".gz" : String(asset.path), asset.contentType);
+        if(gzip) {
+            response->addHeader("Content-Encoding", "gzip");
+        }
+    }
+    if(asset.gzipEtag.length() > 0) {
+        response->addHeader("Vary", "Accept-Encoding");
+    }
+    response->addHeader("ETag", etag);
+    response->addHeader("Cache-Control", asset.cacheControl);
+    request->send(response);
+}
+
+void sendStaticAsset(AsyncWebServerRequest* request, const char* url) {
+    for (StaticAsset& asset : staticAssets) {
+        if(strcmp(url, asset.url) == 0) {
+            sendStaticAsset(request, asset);
+            return;
+        }
+    }
+    request->send(404, "text/plain", "Not found");
+}
+
+/**
+ * One handler for all entries of staticAssets
+ */
+void handleStaticAsset(AsyncWebServerRequest* request) {
+    sendStaticAsset(request, request->url().c_str());
 }
 
 void handleIndexPage(AsyncWebServerRequest* request) {
     if(isDisplaySelect->getValue()) { // is display
-        request->send(SPIFFS, "/index.html", String("text/html"), false, processor);
+        sendStaticAsset(request, "/index.html");
     } else {
         handleUpdatePage(request);
     }
 }
 
 void handleCaptive(AsyncWebServerRequest* request) {
-    request->send(SPIFFS, "/captive.html", String("text/html"), false, processor);
+    sendStaticAsset(request, "/captive.html");
+}
+
+/**
+ * Live replay ring. Event ids are the session epoch in the upper bits and the trigger sequence number of the active session
+ * (1 = first trigger) in the lower bits, so a reconnecting client's Last-Event-ID tells exactly what it is missing, and an id
+ * from before a new session or a reboot never matches
+ */
+#define LIVE_REPLAY_RING_SIZE 64
+#define LIVE_REPLAY_JSON_SIZE (LIVE_REPLAY_RING_SIZE * 40 + 3) // longest trigger object is 38 chars plus separator
+#define LIVE_EVENT_SEQ_BITS 22 // longer sessions get init events only
+#define LIVE_EVENT_SEQ_MASK ((uint32_t(1) << LIVE_EVENT_SEQ_BITS) - 1)
+
+struct LiveReplayEntry {
+    uint32_t seq;
+    Trigger trigger;
+};
+
+LiveReplayEntry liveReplayRing[LIVE_REPLAY_RING_SIZE];
+uint32_t liveReplayEpoch = 0; // session the ring belongs to
+uint32_t liveReplayNewestSeq = 0;
+size_t liveReplayCount = 0;
+uint32_t liveReplaySentId = 0; // newest event id broadcasted to all clients
+portMUX_TYPE liveReplayMux = portMUX_INITIALIZER_UNLOCKED; // written by the loop, read by the async tcp task
+
+/**
+ * The init event, serialised once per change on the loop and shared by every connecting client
+ */
+struct LiveInitEvent {
+    String json;
+    uint32_t id;
+};
+std::shared_ptr<const LiveInitEvent> liveInitEvent; // guarded by liveReplayMux
+
+uint32_t liveEventId(uint32_t epoch, uint32_t seq) {
+    return (epoch << LIVE_EVENT_SEQ_BITS) | (seq & LIVE_EVENT_SEQ_MASK);
 }
 
-void resolveLiveRequests(size_t newTriggerCount) {
-    Serial.println("Resolving live requests");
-    TrainingsSession cachedSession = spiffsLogic.getActiveTraining();
+/**
+ * Empties the ring if the active session changed. Call with liveReplayMux held
+ */
+void syncLiveReplayEpoch(uint32_t epoch) {
+    if(epoch == liveReplayEpoch) return;
+    liveReplayEpoch = epoch;
+    liveReplayNewestSeq = 0;
+    liveReplayCount = 0;
+}
+
+void liveTriggerAdded(const Trigger& trigger) {
+    uint32_t seq = spiffsLogic.getActiveTraining().getTriggerCount();
+    portENTER_CRITICAL(&liveReplayMux);
+    syncLiveReplayEpoch(spiffsLogic.getSessionEpoch());
+    liveReplayRing[seq % LIVE_REPLAY_RING_SIZE] = LiveReplayEntry { seq, trigger };
+    liveReplayNewestSeq = seq;
+    liveReplayCount = min(liveReplayCount + 1, size_t(LIVE_REPLAY_RING_SIZE));
+    portEXIT_CRITICAL(&liveReplayMux);
+}
+
+/**
+ * Adds all triggers after the event afterId as array
+ * @param triggers scratch space for LIVE_REPLAY_RING_SIZE triggers, so the ring is only locked while copying
+ * @return false if afterId belongs to another session or is not covered by the ring anymore
+ */
+bool buildLiveReplay(JsonBuilder& builder, uint32_t afterId, uint32_t& newestId, Trigger* triggers) {
+    size_t count = 0;
+    const uint32_t afterSeq = afterId & LIVE_EVENT_SEQ_MASK;
+    portENTER_CRITICAL(&liveReplayMux);
+    newestId = liveEventId(liveReplayEpoch, liveReplayNewestSeq);
+    uint32_t oldestSeq = liveReplayNewestSeq - liveReplayCount + 1;
+    bool covered = liveEventId(liveReplayEpoch, afterSeq) == afterId && liveReplayNewestSeq <= LIVE_EVENT_SEQ_MASK
+        && afterSeq <= liveReplayNewestSeq && afterSeq + 1 >= oldestSeq;
+    if(covered) {
+        for (uint32_t seq = afterSeq + 1; seq <= liveReplayNewestSeq; seq++) {
+            triggers[count++] = liveReplayRing[seq % LIVE_REPLAY_RING_SIZE].trigger;
+        }
+    }
+    portEXIT_CRITICAL(&liveReplayMux);
+    if(!covered) return false;
+    builder.startArray();
+    for (size_t i = 0; i < count; i++) {
+        builder.insertTriggerObj(triggers[i]);
+    }
+    builder.endArray();
+    return true;
+}
+
+/**
+ * Loop only. Reads the active session in place
+ */
+void updateLiveInitEvent() {
+    TrainingsSession& activeSession = spiffsLogic.getActiveTraining();
+    const uint32_t epoch = spiffsLogic.getSessionEpoch();
     JsonBuilder builder = JsonBuilder();
+    builder.reserve(activeSession.getCache().getSize() * 40 + 2);
     builder.startArray();
-    builder.insertTriggerObj(cachedSession.getCache().getLast()); // only last trigger
-    // for (auto &&trigger : cachedSession.getCache()) {
-    //     builder.insertTriggerObj(trigger);
-    // }
+    for (auto &&trigger : activeSession.getCache()) {
+        builder.insertTriggerObj(trigger);
+    }
     builder.endArray();
-    String json = builder.getJson();
-    liveEventHandler.send(json.c_str(), "update", millis());
+    std::shared_ptr<const LiveInitEvent> event = std::make_shared<const LiveInitEvent>(LiveInitEvent { builder.getJson(), liveEventId(epoch, activeSession.getTriggerCount()) });
+    portENTER_CRITICAL(&liveReplayMux);
+    syncLiveReplayEpoch(epoch); // a new session without triggers yet
+    liveInitEvent.swap(event);
+    portEXIT_CRITICAL(&liveReplayMux);
+} // the old event is freed here, or by the last client still sending it
+
+std::shared_ptr<const LiveInitEvent> getLiveInitEvent() {
+    portENTER_CRITICAL(&liveReplayMux);
+    std::shared_ptr<const LiveInitEvent> event = liveInitEvent;
+    portEXIT_CRITICAL(&liveReplayMux);
+    return event;
+}
+
+/**
+ * Loop only
+ */
+bool isLiveUpdatePending() {
+    return !liveInitEvent || spiffsLogic.getSessionEpoch() != liveReplayEpoch || liveEventId(liveReplayEpoch, liveReplayNewestSeq) != liveReplaySentId;
+}
+
+/**
+ * Broadcasts every trigger added since the last call as one event, or an init event after a new session.
+ * The message is formatted once for all clients
+ */
+void resolveLiveRequests() {
+    updateLiveInitEvent();
+    static char json[LIVE_REPLAY_JSON_SIZE];
+    static Trigger triggers[LIVE_REPLAY_RING_SIZE];
+    JsonBuilder builder = JsonBuilder(json, sizeof(json));
+    uint32_t newestId;
+    if(buildLiveReplay(builder, liveReplaySentId, newestId, triggers)) {
+        if(newestId != liveReplaySentId) {
+            liveEventHandler.send(builder.c_str(), "update", newestId);
+        }
+    } else {
+        std::shared_ptr<const LiveInitEvent> event = getLiveInitEvent();
+        liveEventHandler.send(event->json.c_str(), "init", event->id);
+    }
+    liveReplaySentId = newestId;
 }
 
+/**
+ * Runs on the async tcp task only, so the buffers can be static instead of taking 3kb of its stack
+ */
 void handleLiveConnect(AsyncEventSourceClient *client) {
     if(client->lastId()){
         Serial.printf("Client reconnected! Last message ID that it got is: %u\n", client->lastId());
+        static char json[LIVE_REPLAY_JSON_SIZE];
+        static Trigger triggers[LIVE_REPLAY_RING_SIZE];
+        JsonBuilder builder = JsonBuilder(json, sizeof(json));
+        uint32_t newestId;
+        if(buildLiveReplay(builder, client->lastId(), newestId, triggers)) {
+            if(newestId != client->lastId()) {
+                client->send(builder.c_str(), "update", newestId);
+            }
+            return; // caught up
+        }
     }
-    // send event with message "hello!", id current millis
-    // and set reconnect delay to 1 second
-    
-    TrainingsSession cachedSession = spiffsLogic.getActiveTraining();
-    JsonBuilder builder = JsonBuilder();
-    builder.startArray();
-    for (auto &&trigger : cachedSession.getCache()) {
-        builder.insertTriggerObj(trigger);
+    std::shared_ptr<const LiveInitEvent> event = getLiveInitEvent();
+    if(event) {
+        client->send(event->json.c_str(), "init", event->id);
+    }
+}
+
+/**
+ * Read only copy of the session list for handlers running on the async_tcp task.
+ * The loop builds a new one whenever the session list changes and swaps the pointer, so it never waits for a reader
+ * and readers never see a half updated list. The old copy is freed by its last reader.
+ * The growing size of the active session is published on its own, so triggers dont copy the whole list
+ */
+struct SessionCatalog {
+    DoubleLinkedList<TrainingsMeta> metas;
+    String activeFileName;
+    size_t activeFileSize; // when published. getActiveSessionSize() is current
+    size_t bytesUsed;
+    size_t bytesTotal;
+
+    bool hasSession(const String& fileName) const {
+        for (auto &&meta : metas) {
+            if(meta.fileName == fileName) return true;
+        }
+        return false;
+    }
+};
+
+std::shared_ptr<const SessionCatalog> sessionCatalog;
+uint32_t sessionCatalogVersion = 0; // spiffsLogic.getSessionListVersion() of the published catalog
+size_t activeSessionSize = 0; // guarded by sessionCatalogMux
+portMUX_TYPE sessionCatalogMux = portMUX_INITIALIZER_UNLOCKED;
+
+#define SESSION_NAME_SIZE 48
+#define SESSION_DELETE_QUEUE_LENGTH 8
+
+QueueHandle_t sessionDeleteQueue = nullptr; // char[SESSION_NAME_SIZE]. Sessions are only deleted by the loop
+
+/**
+ * Loop only
+ */
+void publishSessionCatalog() {
+    std::shared_ptr<SessionCatalog> catalog = std::make_shared<SessionCatalog>();
+    catalog->metas = spiffsLogic.getTrainingsMetas();
+    catalog->activeFileName = spiffsLogic.getActiveTraining().getFileName();
+    catalog->activeFileSize = spiffsLogic.getActiveSessionSize();
+    catalog->bytesUsed = spiffsLogic.getBytesUsed();
+    catalog->bytesTotal = spiffsLogic.getBytesTotal();
+    std::shared_ptr<const SessionCatalog> published = catalog;
+    portENTER_CRITICAL(&sessionCatalogMux);
+    sessionCatalog.swap(published);
+    activeSessionSize = catalog->activeFileSize;
+    portEXIT_CRITICAL(&sessionCatalogMux);
+    sessionCatalogVersion = spiffsLogic.getSessionListVersion();
+}
+
+/**
+ * Loop only. Once per trigger
+ */
+void publishActiveSessionSize() {
+    portENTER_CRITICAL(&sessionCatalogMux);
+    activeSessionSize = spiffsLogic.getActiveSessionSize();
+    portEXIT_CRITICAL(&sessionCatalogMux);
+}
+
+std::shared_ptr<const SessionCatalog> getSessionCatalog() {
+    portENTER_CRITICAL(&sessionCatalogMux);
+    std::shared_ptr<const SessionCatalog> catalog = sessionCatalog;
+    portEXIT_CRITICAL(&sessionCatalogMux);
+    return catalog;
+}
+
+size_t getActiveSessionSize() {
+    portENTER_CRITICAL(&sessionCatalogMux);
+    size_t size = activeSessionSize;
+    portEXIT_CRITICAL(&sessionCatalogMux);
+    return size;
+}
+
+/**
+ * Any task. The session is deleted by the loop in deleteQueuedSessions()
+ */
+bool queueSessionDelete(const String& fileName, TickType_t wait) {
+    char name[SESSION_NAME_SIZE];
+    strlcpy(name, fileName.c_str(), sizeof(name));
+    return xQueueSend(sessionDeleteQueue, name, wait) == pdTRUE;
+}
+
+void deleteQueuedSessions() {
+    char fileName[SESSION_NAME_SIZE];
+    while(xQueueReceive(sessionDeleteQueue, fileName, 0) == pdTRUE) {
+        if(spiffsLogic.deleteSession(fileName)) {
+            Serial.printf("Deleted %s\n", fileName);
+        } else {
+            Serial.printf("Could not delete session %s\n", fileName);
+        }
     }
-    builder.endArray();
-    client->send(builder.getJson().c_str(), "init", millis());
 }
 
 void handleSession(AsyncWebServerRequest* request) {
@@ -126,55 +515,295 @@ void handleSession(AsyncWebServerRequest* request) {
     }
     String name = request->getParam("name")->value();
     int id = name.toInt();
-    if(!spiffsLogic.hasTraining(name)) {
+    if(!getSessionCatalog()->hasSession(name)) {
         request->send(404, "text/plain", "Session not found");
         return;
     }
-    TrainingsSession session = spiffsLogic.getTraining(name);
-    size_t page = 0;
-    if(request->hasParam("page")) {
-        page = request->getParam("page")->value().toInt();
+    std::shared_ptr<TrainingsSession> session = std::make_shared<TrainingsSession>(spiffsLogic.getTraining(name));
+    DoubleLinkedList<SessionPageInfo> pages = session->getSessionPages();
+    String page = request->hasParam("page") ? request->getParam("page")->value() : String("0");
+    size_t pageStart = 0;
+    size_t pageEnd = SIZE_MAX; // page=all streams the whole session
+    if(request->hasParam("since")) { // only triggers from index since on. "next" in the response is the since for the following call
+        page = "all";
+        pageStart = request->getParam("since")->value().toInt();
     }
-    if(page >= session.getPageCount()) {
-        request->send(400, "text/plain", "Page doesnt exist");
-        return;
+    if(page != "all") {
+        if(size_t(page.toInt()) >= pages.getSize()) {
+            request->send(400, "text/plain", "Page doesnt exist");
+            return;
+        }
+        pageStart = pages.get(page.toInt()).pageStart;
+        pageEnd = pages.get(page.toInt()).pageEnd;
     }
-    JsonBuilder jsonBuilder;
-    jsonBuilder.startObject();
-    jsonBuilder.addKey("triggers");
-    DoubleLinkedList<SessionPageInfo> pages = buildSessionTriggers(jsonBuilder, session, page);
-    jsonBuilder.addKey("maxPages");
-    jsonBuilder.addValue(int(pages.getSize()));
-    jsonBuilder.endObject();
+    Serial.printf("Page %s from %i to %i\n", page.c_str(), pageStart, pageEnd);
+    session->beginStream();
+    session->skip(pageStart);
+    size_t triggerIndex = pageStart;
+    int maxPages = pages.getSize();
+    bool started = false;
+    sendJsonStream(request, [session, triggerIndex, pageEnd, maxPages, started](JsonBuilder& builder) mutable -> bool {
+        if(!started) {
+            builder.startObject();
+            builder.addKey("triggers");
+            builder.startArray();
+            started = true;
+            return true;
+        }
+        for (size_t i = 0; i < JSON_TRIGGERS_PER_PIECE && session->hasNext() && triggerIndex <= pageEnd; i++) {
+            builder.insertTriggerObj(session->next());
+            triggerIndex++;
+        }
+        if(session->hasNext() && triggerIndex <= pageEnd) {
+            return true;
+        }
+        builder.endArray();
+        builder.addKey("maxPages");
+        builder.addValue(maxPages);
+        builder.addKey("next");
+        builder.addValue(int(triggerIndex));
+        builder.endObject();
+        session->endStream();
+        return false;
+    });
+}
 
-    request->send(200, "application/json", jsonBuilder.getJson());
+void insertTimeStats(JsonBuilder& builder, const char* key, TimeStats& stats) {
+    builder.addKey(key);
+    builder.startObject();
+    builder.addKey("count");
+    builder.addValue(int(stats.count));
+    builder.addKey("best");
+    builder.addValue(int(stats.best));
+    builder.addKey("avg");
+    builder.addValue(int(stats.avg()));
+    builder.addKey("median");
+    builder.addValue(int(stats.median.get()));
+    builder.endObject();
 }
 
-void handleInPositionMp3(AsyncWebServerRequest* request) {
-    AsyncWebServerResponse* response = request->beginResponse(SPIFFS, "/inPosition.mp3", "audio/mpeg");
-    request->send(response);
+void insertSpeedStats(JsonBuilder& builder, const char* key, SpeedStats& stats) {
+    builder.addKey(key);
+    builder.startObject();
+    builder.addKey("best");
+    builder.addValue(stats.bestKmh);
+    builder.addKey("avg");
+    builder.addValue(stats.avgKmh());
+    builder.endObject();
 }
 
-void handleSetMp3(AsyncWebServerRequest* request) {
-    AsyncWebServerResponse* response = request->beginResponse(SPIFFS, "/set.mp3", "audio/mpeg");
-    request->send(response);
+void insertStatsLap(JsonBuilder& builder, const StatsLap& lap) {
+    builder.startObject();
+    builder.addKey("index");
+    builder.addValue(int(lap.index));
+    builder.addKey("ms");
+    builder.addValue(int(lap.timeMs));
+    builder.addKey("mm");
+    builder.addValue(int(lap.millimeters));
+    builder.addKey("done");
+    builder.addValue(lap.done);
+    builder.addKey("parcour");
+    builder.addValue(lap.parcour);
+    builder.addKey("splits");
+    builder.startArray();
+    for (size_t i = 0; i < lap.splitCount; i++) {
+        builder.startObject();
+        builder.addKey("index");
+        builder.addValue(int(lap.splits[i].index));
+        builder.addKey("ms");
+        builder.addValue(int(lap.splits[i].timeMs));
+        builder.addKey("mm");
+        builder.addValue(int(lap.splits[i].millimeters));
+        builder.addKey("finish");
+        builder.addValue(lap.splits[i].isFinish);
+        builder.endObject();
+    }
+    builder.endArray();
+    builder.endObject();
 }
 
-void handleBeepMp3(AsyncWebServerRequest* request) {
-    AsyncWebServerResponse* response = request->beginResponse(SPIFFS, "/beep.mp3", "audio/mpeg");
-    request->send(response);
+#define STATS_TRIGGERS_PER_PIECE 32
+
+/**
+ * Start of the ETags of a session file: "\"<name>-<crc32 of the first trigger>-".
+ * Names are reused once the newest session is deleted, the first trigger tells the files apart
+ */
+String sessionETagPrefix(const String& name, File& file) {
+    uint8_t first[sizeof(Trigger)];
+    file.seek(0);
+    size_t read = file.read(first, sizeof(first));
+    file.seek(0);
+    char id[10];
+    sprintf(id, "%08x", (unsigned int) crc32_le(0, first, read));
+    return String("\"") + name + "-" + id + "-";
 }
 
-void handleLogo(AsyncWebServerRequest* request) {
-    AsyncWebServerResponse* response = request->beginResponse(SPIFFS, "/logo.png", "image/png");
-    request->send(response);
+/**
+ * Laps, splits and summary of a session in one pass over its file.
+ * Closed sessions never change, so their result is cached next to the session and served with an ETag
+ */
+void handleStats(AsyncWebServerRequest* request) {
+    if(!request->hasParam("name")) {
+        request->send(400, "text/plain", "please provide the session name");
+        return;
+    }
+    String name = request->getParam("name")->value();
+    std::shared_ptr<const SessionCatalog> catalog = getSessionCatalog();
+    if(!catalog->hasSession(name)) {
+        request->send(404, "text/plain", "Session not found");
+        return;
+    }
+    bool running = name == catalog->activeFileName;
+    String cachePath = String("/") + name + SESSION_STATS_CACHE_SUFFIX;
+    File sessionFile;
+    if(!running && SPIFFS.exists(cachePath) && (sessionFile = SPIFFS.open(String("/") + name, FILE_READ, false))) {
+        String etag = sessionETagPrefix(name, sessionFile) + String(sessionFile.size()) + "-stats\"";
+        sessionFile.close();
+        if(request->hasHeader("If-None-Match") && request->header("If-None-Match") == etag) {
+            AsyncWebServerResponse* response = request->beginResponse(304);
+            response->addHeader("ETag", etag);
+            request->send(response);
+            return;
+        }
+        AsyncWebServerResponse* response = request->beginResponse(SPIFFS, cachePath, "application/json");
+        response->addHeader("ETag", etag);
+        response->addHeader("Cache-Control", CACHE_CONTROL_REVALIDATE);
+        request->send(response);
+        return;
+    }
+    std::shared_ptr<TrainingsSession> session = std::make_shared<TrainingsSession>(spiffsLogic.getTraining(name));
+    std::shared_ptr<SessionAnalyser> analyser = std::make_shared<SessionAnalyser>();
+    session->beginStream();
+    bool started = false;
+    sendJsonStream(request, [session, analyser, started](JsonBuilder& builder) mutable -> bool {
+        auto onLap = [&builder](const StatsLap& lap) {
+            insertStatsLap(builder, lap);
+        };
+        if(!started) {
+            builder.startObject();
+            builder.addKey("laps");
+            builder.startArray();
+            started = true;
+            return true;
+        }
+        for (size_t i = 0; i < STATS_TRIGGERS_PER_PIECE && session->hasNext(); i++) {
+            analyser->add(session->next(), onLap);
+        }
+        if(session->hasNext()) {
+            return true;
+        }
+        session->endStream();
+        analyser->finish(onLap);
+        builder.endArray();
+        insertTimeStats(builder, "lap", analyser->laps);
+        insertSpeedStats(builder, "lapKmh", analyser->lapSpeeds);
+        insertTimeStats(builder, "parcour", analyser->parcour);
+        insertSpeedStats(builder, "parcourKmh", analyser->parcourSpeeds);
+        builder.addKey("checkpoints");
+        builder.startArray();
+        for (size_t i = 0; i < analyser->checkpointCount; i++) {
+            builder.startObject();
+            builder.addKey("mm");
+            builder.addValue(int(analyser->checkpoints[i].millimeters));
+            insertTimeStats(builder, "time", analyser->checkpoints[i].times);
+            builder.endObject();
+        }
+        builder.endArray();
+        builder.endObject();
+        return false;
+    }, running ? String() : cachePath);
 }
 
-void handleUserManual(AsyncWebServerRequest* request) {
-    AsyncWebServerResponse* response = request->beginResponse(SPIFFS, "/user-manual.html", "text/html");
+/**
+ * Raw session file (packed Triggers). Sessions are append only so file id and size make a valid ETag.
+ * Supports a single "Range: bytes=start-end", "bytes=start-" or "bytes=-suffix", If-None-Match and If-Range.
+ * If-Range takes the ETag of any earlier size of the same file, because the cached copy is a prefix of it
+ */
+void handleSessionBin(AsyncWebServerRequest* request) {
+    if(!request->hasParam("name")) {
+        request->send(400, "text/plain", "please provide the session name");
+        return;
+    }
+    String name = request->getParam("name")->value();
+    if(!getSessionCatalog()->hasSession(name)) {
+        request->send(404, "text/plain", "Session not found");
+        return;
+    }
+    String path = String("/") + name;
+    File file = SPIFFS.open(path, FILE_READ, false);
+    if(!file) {
+        request->send(500, "text/plain", "Could not open session");
+        return;
+    }
+    size_t fileSize = file.size();
+    String etagPrefix = sessionETagPrefix(name, file);
+    String etag = etagPrefix + String(fileSize) + "\"";
+    if(request->hasHeader("If-None-Match") && request->header("If-None-Match") == etag) {
+        file.close();
+        AsyncWebServerResponse* response = request->beginResponse(304);
+        response->addHeader("ETag", etag);
+        request->send(response);
+        return;
+    }
+    size_t rangeStart = 0;
+    size_t rangeEnd = fileSize == 0 ? 0 : fileSize - 1;
+    bool isRange = false;
+    bool rangeValid = !request->hasHeader("If-Range") || request->header("If-Range").startsWith(etagPrefix);
+    if(request->hasHeader("Range") && fileSize > 0 && rangeValid) { // another file of the same name gets a full 200
+        String range = request->header("Range");
+        int dash = range.indexOf('-');
+        if(!range.startsWith("bytes=") || dash < 0) {
+            file.close();
+            request->send(416, "text/plain", "Unsupported range");
+            return;
+        }
+        bool hasEnd = dash + 1 < int(range.length());
+        if(dash == 6) { // suffix range "bytes=-N" means the last N bytes
+            size_t suffix = hasEnd ? range.substring(dash + 1).toInt() : 0;
+            rangeStart = fileSize - min(suffix, fileSize);
+            if(suffix == 0) rangeStart = fileSize; // unsatisfiable
+        } else {
+            rangeStart = range.substring(6, dash).toInt();
+            if(hasEnd) {
+                rangeEnd = min(size_t(range.substring(dash + 1).toInt()), fileSize - 1);
+            }
+        }
+        if(rangeStart > rangeEnd) {
+            file.close();
+            AsyncWebServerResponse* response = request->beginResponse(416);
+            response->addHeader("Content-Range", String("bytes */") + String(fileSize));
+            request->send(response);
+            return;
+        }
+        isRange = true;
+    }
+    std::shared_ptr<File> sharedFile = std::make_shared<File>(file);
+    sharedFile->seek(rangeStart);
+    size_t length = fileSize == 0 ? 0 : rangeEnd - rangeStart + 1;
+    AsyncWebServerResponse* response = request->beginResponse("application/octet-stream", length, [sharedFile](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+        return sharedFile->read(buffer, maxLen); // straight from flash into the tcp buffer
+    });
+    if(isRange) {
+        response->setCode(206);
+        response->addHeader("Content-Range", String("bytes ") + String(rangeStart) + "-" + String(rangeEnd) + "/" + String(fileSize));
+    }
+    response->addHeader("Accept-Ranges", "bytes");
+    response->addHeader("ETag", etag);
+    response->addHeader("Cache-Control", "no-cache"); // always revalidate, active sessions grow
     request->send(response);
 }
 
+/**
+ * Raw ring file. Decode with replay_capture.py
+ */
+void handleRadioCaptureDownload(AsyncWebServerRequest* request) {
+    if(!SPIFFS.exists(RADIO_CAPTURE_FILE)) {
+        request->send(404, "text/plain", "No capture recorded");
+        return;
+    }
+    request->send(SPIFFS, RADIO_CAPTURE_FILE, "application/octet-stream", true);
+}
+
 void handleStartIn(AsyncWebServerRequest* request) {
     if(!request->hasParam("delayMs")) {
         request->send(400, "text/html", "No delayMs");
@@ -187,12 +816,20 @@ void handleStartIn(AsyncWebServerRequest* request) {
 void handleDeleteSession(AsyncWebServerRequest* request) {
     if(!request->hasParam("name")) {
         request->send(400, "text/html", "Name missing");
+        return;
     }
-    if(spiffsLogic.getActiveTraining().getFileName().equals(request->getParam("name")->value())) {
+    String name = request->getParam("name")->value();
+    std::shared_ptr<const SessionCatalog> catalog = getSessionCatalog();
+    if(catalog->activeFileName == name) {
         request->send(400, "text/html", "Cant delete active session");
+        return;
     }
-    if(!spiffsLogic.deleteSession(request->getParam("name")->value())) {
-        request->send(500, "text/html", "Error");
+    if(!catalog->hasSession(name)) {
+        request->send(404, "text/html", "Session not found");
+        return;
+    }
+    if(!queueSessionDelete(name, 0)) {
+        request->send(503, "text/html", "Busy");
     } else {
         request->send(200, "text/html", "Done");
     }
@@ -322,84 +959,204 @@ void handleWiFiSettings(AsyncWebServerRequest* request) {
     // request->send(200, "text/html", String("Please reconnect to ") + String(APSsid));
 }
 
+/**
+ * Shared by /settings and the control socket. Does not write preferences
+ * @return false for unknown keys or invalid values
+ */
+bool applySetting(const String& key, const String& value) {
+    if(key == "displayBrightness") {
+        displayBrightnessInput->setValue(value.toInt());
+    } else if(key == "displayTime") {
+        displayTimeInput->setValue(int(value.toFloat()));
+    } else if(key == "fontSize") {
+        fontSizeSelect->setValue(value.toInt());
+    } else if(key == "username") {
+        username = value;
+        cloudUploadEnabled->setChecked(true);
+    } else if(key == "wifiSSID") {
+        uploadWifiSSID = value;
+    } else if(key == "wifiPassword") {
+        uploadWifiPassword = value;
+    } else if(key == "lapDisplayType") {
+        const int lapDisplayType = value.toInt();
+        if(lapDisplayType < 0 || lapDisplayType > 1) return false;
+        lapDisplayTypeSelect->setValue(lapDisplayType);
+    } else {
+        return false;
+    }
+    return true;
+}
+
 void handleSettings(AsyncWebServerRequest* request) {
-    if(request->hasParam("displayBrightness")) {
-        int displayBrightness = request->getParam("displayBrightness")->value().toInt();
-        displayBrightnessInput->setValue(displayBrightness);
+    for (size_t i = 0; i < request->params(); i++) {
+        AsyncWebParameter* param = request->getParam(i);
+        applySetting(param->name(), param->value());
     }
-    if(request->hasParam("displayTime")) {
-        int displayTime = request->getParam("displayTime")->value().toFloat();
-        displayTimeInput->setValue(displayTime);
+    writePreferences();
+    request->send(200, "text/html", "OK");
+}
+
+/**
+ * Control socket. One text message per command, every command is acked:
+ *  "p <id> <phoneMs>"              ping.    => "p <id> <phoneMs> <deviceMs>"
+ *  "s <id> <deviceMs>"             start gun at device time. => "a <id> <scheduled deviceMs>"
+ *  "b <id> <start|stop|lap|split>" stopwatch button taken at receive time. => "a <id> ok"
+ *  "c <id> <key> <value>"          setting, same keys as /settings. => "a <id> ok"
+ * Errors are acked with "e <id>"
+ * Phones estimate the clock offset from the pings and schedule starts in device time
+ */
+#define CONTROL_MESSAGE_MAX 96
+
+QueueHandle_t controlTriggerQueue = nullptr; // stopwatch triggers from phones, stored by the loop
+extern uint16_t stopWatchLap; // found in GuiLogic
+
+bool handleControlCommand(AsyncWebSocketClient* client, char* message, timeMs_t receivedMs) {
+    char command;
+    unsigned long id;
+    int consumed = 0;
+    if(sscanf(message, "%c %lu %n", &command, &id, &consumed) < 2) return false;
+    char* args = message + consumed;
+    char response[CONTROL_MESSAGE_MAX];
+    if(command == 'p') {
+        snprintf(response, sizeof(response), "p %lu %s %li", id, args, long(receivedMs));
+        client->text(response);
+        return true;
     }
-    if(request->hasParam("fontSize")) {
-        fontSizeSelect->setValue(request->getParam("fontSize")->value().toInt());
+    if(command == 's') {
+        timeMs_t startMs = atol(args);
+        if(startMs < receivedMs) {
+            startMs = receivedMs; // already late. Start now and tell by how much
+        }
+        startGunTime = startMs;
+        snprintf(response, sizeof(response), "a %lu %li", id, long(startMs));
+        client->text(response);
+        return true;
     }
-    if(request->hasParam("username")) {
-        username = request->getParam("username")->value();
-        cloudUploadEnabled->setChecked(true);
+    if(command == 'b') {
+        Trigger trigger = Trigger { receivedMs, 0, STATION_TRIGGER_TYPE_NONE };
+        if(strcmp(args, "start") == 0) {
+            trigger.triggerType = STATION_TRIGGER_TYPE_START;
+        } else if(strcmp(args, "stop") == 0) {
+            trigger.triggerType = STATION_TRIGGER_TYPE_FINISH;
+        } else if(strcmp(args, "lap") == 0) {
+            trigger.triggerType = STATION_TRIGGER_TYPE_CHECKPOINT;
+        } else if(strcmp(args, "split") == 0) {
+            trigger.triggerType = STATION_TRIGGER_TYPE_START_FINISH;
+        } else {
+            return false;
+        }
+        if(xQueueSend(controlTriggerQueue, &trigger, 0) != pdTRUE) return false;
+    } else if(command == 'c') {
+        char* value = strchr(args, ' ');
+        if(!value) return false;
+        *value++ = 0;
+        if(!applySetting(String(args), String(value))) return false;
+        writePreferences();
+    } else {
+        return false;
     }
-    if(request->hasParam("wifiSSID")) {
-        uploadWifiSSID = request->getParam("wifiSSID")->value();
+    snprintf(response, sizeof(response), "a %lu ok", id);
+    client->text(response);
+    return true;
+}
+
+void handleControlEvent(AsyncWebSocket* socket, AsyncWebSocketClient* client, AwsEventType type, void* arg, uint8_t* data, size_t len) {
+    timeMs_t receivedMs = millis();
+    if(type == WS_EVT_CONNECT) {
+        Serial.printf("Control client #%u connected\n", client->id());
+        return;
     }
-    if(request->hasParam("wifiPassword")) {
-        uploadWifiPassword = request->getParam("wifiPassword")->value();
+    if(type != WS_EVT_DATA) return;
+    AwsFrameInfo* info = (AwsFrameInfo*) arg;
+    if(!info->final || info->index != 0 || info->len != len || info->opcode != WS_TEXT) return; // commands are single small frames
+    char message[CONTROL_MESSAGE_MAX];
+    size_t size = min(len, sizeof(message) - 1);
+    memcpy(message, data, size);
+    message[size] = 0;
+    if(!handleControlCommand(client, message, receivedMs)) {
+        unsigned long id = 0;
+        sscanf(message, "%*c %lu", &id);
+        char response[16];
+        snprintf(response, sizeof(response), "e %lu", id);
+        client->text(response);
     }
-    if(request->hasParam("lapDisplayType")) {
-        const int lapDisplayType = request->getParam("lapDisplayType")->value().toInt();
-        if(lapDisplayType >= 0 && lapDisplayType <= 1) {
-            lapDisplayTypeSelect->setValue(lapDisplayType);
+}
+
+/**
+ * Loop side of the control socket
+ */
+void handleControlSocket() {
+    if(controlTriggerQueue == nullptr) return;
+    Trigger trigger;
+    while(xQueueReceive(controlTriggerQueue, &trigger, 0) == pdTRUE) {
+        if(trigger.triggerType == STATION_TRIGGER_TYPE_START) {
+            stopWatchLap = 0;
         }
+        if(trigger.triggerType == STATION_TRIGGER_TYPE_CHECKPOINT) {
+            trigger.millimeters = stopWatchLap++;
+        }
+        masterTrigger(trigger);
     }
-    writePreferences();
-    request->send(200, "text/html", "OK");
+    controlSocket.cleanupClients();
 }
 
 void handleSessionsJson(AsyncWebServerRequest* request) {
-    const DoubleLinkedList<TrainingsMeta>& metas = spiffsLogic.getTrainingsMetas();
-    JsonBuilder builder = JsonBuilder();
-    builder.startObject();
-    builder.addKey("displayTime");
-    builder.addValue(int(displayTimeInput->getValue()));
-    builder.addKey("displayBrightness");
-    builder.addValue(float(displayBrightnessInput->getValue()));
-    builder.addKey("fontSize");
-    builder.addValue(int(fontSizeSelect->getValue()));
-    builder.addKey("lapDisplayType");
-    builder.addValue(lapDisplayTypeSelect->getValue());
-    builder.addKey("username");
-    builder.addValue(username);
-    builder.addKey("wifiSSID");
-    builder.addValue(uploadWifiSSID);
-    builder.addKey("wifiPassword");
-    builder.addValue(uploadWifiPassword);
-    builder.addKey("APSsid");
-    builder.addValue(APSsid);
-    builder.addKey("APPassword");
-    builder.addValue(APPassword);
-    builder.addKey("sessions");
-    builder.startArray();
-    for (TrainingsMeta &metadata : metas) {
-        builder.startObject();
-        builder.addKey("fileSize");
-        builder.addValue(int(metadata.fileSize));
-        builder.addKey("fileName");
-        builder.addValue(metadata.fileName);
-        builder.addKey("triggerCount");
-        builder.addValue(int(metadata.fileSize / sizeof(Trigger)));
+    std::shared_ptr<const SessionCatalog> catalog = getSessionCatalog();
+    const size_t activeFileSize = getActiveSessionSize();
+    DoubleLinkedList<TrainingsMeta>::Iterator meta = catalog->metas.begin();
+    bool started = false;
+    sendJsonStream(request, [catalog, activeFileSize, meta, started](JsonBuilder& builder) mutable -> bool {
+        if(!started) {
+            builder.startObject();
+            builder.addKey("displayTime");
+            builder.addValue(int(displayTimeInput->getValue()));
+            builder.addKey("displayBrightness");
+            builder.addValue(float(displayBrightnessInput->getValue()));
+            builder.addKey("fontSize");
+            builder.addValue(int(fontSizeSelect->getValue()));
+            builder.addKey("lapDisplayType");
+            builder.addValue(lapDisplayTypeSelect->getValue());
+            builder.addKey("username");
+            builder.addValue(username);
+            builder.addKey("wifiSSID");
+            builder.addValue(uploadWifiSSID);
+            builder.addKey("wifiPassword");
+            builder.addValue(uploadWifiPassword);
+            builder.addKey("APSsid");
+            builder.addValue(APSsid);
+            builder.addKey("APPassword");
+            builder.addValue(APPassword);
+            builder.addKey("sessions");
+            builder.startArray();
+            started = true;
+            return true;
+        }
+        if(meta != catalog->metas.end()) {
+            const TrainingsMeta& metadata = *meta;
+            ++meta;
+            const size_t fileSize = metadata.fileName == catalog->activeFileName ? activeFileSize : metadata.fileSize;
+            builder.startObject();
+            builder.addKey("fileSize");
+            builder.addValue(int(fileSize));
+            builder.addKey("fileName");
+            builder.addValue(metadata.fileName);
+            builder.addKey("triggerCount");
+            builder.addValue(int(fileSize / sizeof(Trigger)));
+            builder.endObject();
+            return true;
+        }
+        builder.endArray();
+        builder.addKey("bytesUsed");
+        builder.addValue(int(catalog->bytesUsed + activeFileSize - catalog->activeFileSize));
+        builder.addKey("bytesTotal");
+        builder.addValue(int(catalog->bytesTotal));
         builder.endObject();
-    }
-    builder.endArray();
-    builder.addKey("bytesUsed");
-    builder.addValue(int(spiffsLogic.getBytesUsed()));
-    builder.addKey("bytesTotal");
-    builder.addValue(int(spiffsLogic.getBytesTotal()));
-    builder.endObject();
-    request->send(200, "application/json", builder.getJson());
+        return false;
+    });
 }
 
 void handleNotFound(AsyncWebServerRequest* request) {
-    AsyncWebServerResponse* response = request->beginResponse(SPIFFS, "/notFound.html", "text/html");
-    request->send(response);
+    sendStaticAsset(request, "/notFound.html");
     // handleIndexPage(request);
     // Redirect to the start page on every connection
     // request->redirect("/");
@@ -407,34 +1164,12 @@ void handleNotFound(AsyncWebServerRequest* request) {
 }
 
 
-/**
- * @brief Get the Triggers of a Session 
- * 
- * @param session the session
- * @param page = 0 will return only the newest Triggers
- * @param json output JSON
- */
-DoubleLinkedList<SessionPageInfo> buildSessionTriggers(JsonBuilder& builder, TrainingsSession& session, size_t page) {
-    DoubleLinkedList<SessionPageInfo> sessionPageInfos = session.getSessionPages();
-    SessionPageInfo sessionPage = sessionPageInfos.get(page);
-    Serial.printf("Page %i from %i to %i\n", page, sessionPage.pageStart, sessionPage.pageEnd);
-    session.beginStream();
-    session.skip(sessionPage.pageStart);
-    size_t currentTriggerIndex = sessionPage.pageStart;
-    builder.startArray();
-    while (session.hasNext() && currentTriggerIndex <= sessionPage.pageEnd) {
-        builder.insertTriggerObj(session.next());
-        currentTriggerIndex++;
-    }
-    builder.endArray();
-    session.endStream();
-    return sessionPageInfos;
-}
-
 bool updateSuccsessfull = false;
 
 void beginWiFi() {
     Serial.println("Starting WiFi");
+    sessionDeleteQueue = xQueueCreate(SESSION_DELETE_QUEUE_LENGTH, SESSION_NAME_SIZE);
+    publishSessionCatalog();
     // WiFi.eraseAP();
     // WiFi.disconnect(false, true);
     WiFi.mode(WIFI_AP_STA);
@@ -448,22 +1183,27 @@ void beginWiFi() {
     // dnsServer.start(DNS_PORT, "*", apIP);
 
     // server.addHandler(new CaptiveRequestHandler()).setFilter(ON_AP_FILTER);
+    server.on("/capture.bin", HTTP_GET, handleRadioCaptureDownload); // stations and displays
     if(isDisplaySelect->getValue() && spiffsLogic.isVersionMatch()) { // is display and spiffs version is correct
+        beginStaticAssets();
         server.on("/", HTTP_GET, handleIndexPage);
+        for (StaticAsset& asset : staticAssets) {
+            server.on(asset.url, HTTP_GET, handleStaticAsset);
+        }
         server.on("/sessions.json", HTTP_GET, handleSessionsJson);
         server.on("/session", HTTP_GET, handleSession);
-        server.on("/inPosition.mp3", HTTP_GET, handleInPositionMp3);
-        server.on("/set.mp3", HTTP_GET, handleSetMp3);
-        server.on("/beep.mp3", HTTP_GET, handleBeepMp3);
+        server.on("/session.bin", HTTP_GET, handleSessionBin);
+        server.on("/stats", HTTP_GET, handleStats);
         server.on("/startIn", HTTP_GET, handleStartIn);
         server.on("/settings", HTTP_GET, handleSettings);
         server.on("/deleteSession", HTTP_GET, handleDeleteSession);
-        server.on("/logo.png", HTTP_GET, handleLogo);
         server.on("/updateCredentials", HTTP_GET, handleWiFiSettings);
-        server.on("/user-manual.html", HTTP_GET, handleUserManual);
         server.on("/update", HTTP_GET, handleUpdatePage); // ipdate page has own url
         server.onNotFound(handleNotFound);
         server.addHandler(&liveEventHandler);
+        controlTriggerQueue = xQueueCreate(8, sizeof(Trigger));
+        controlSocket.onEvent(handleControlEvent);
+        server.addHandler(&controlSocket);
         liveEventHandler.onConnect(handleLiveConnect);
     } else {
         // everything is getting to the update page
@@ -557,105 +1297,208 @@ timeMs_t cloudUploadStart = 0;
 
 char uploadPopupMessage[20];
 
-bool handleCloudUpload() {
-    if(WiFi.status() == WL_CONNECTED) {
-        FastLED.clear();
-        FastLED.setBrightness(10);
-        matrix.print("Uploading", 1, 1, CRGB::BlueViolet, FONT_SIZE_SMALL + FONT_SETTINGS_DEFAULT);
-        FastLED.show();
-        sprintf(uploadPopupMessage, "Cloud upload..");
-        uiManager.popup(uploadPopupMessage);
-        uiManager.handle(true);
-        Serial.printf("Successfully connected to %s!\n", uploadWifiSSID);
-        HTTPClient http;
-
-        String url = "https://www.roller-results.com/api/index.php?uploadResults=1";
-
-        Serial.printf("Uploading %i sessions to: %s with user: %s\n", spiffsLogic.getTrainingsMetas().getSize() - 2, url.c_str(), username);
-
-        Serial.printf("active training: %s\n", spiffsLogic.getActiveTraining().getFileName());
-
-        http.begin(url);
-        http.addHeader("Content-Type", "application/json");
-        size_t trainingsID = 0;
-        bool succsess = true;
-        DoubleLinkedList<String> uploadedFiles = DoubleLinkedList<String>();
-        for (auto &&trainingsMeta : spiffsLogic.getTrainingsMetas()) {
-            if(!spiffsLogic.hasTraining(trainingsMeta.fileName)) continue;
-            if(trainingsMeta.isRunning) continue;
-            Serial.printf("Uploading %s\n", trainingsMeta.fileName);
-            TrainingsSession trainingsSession = spiffsLogic.getTraining(trainingsMeta.fileName);
-            const int maxTriggersPerRequest = 5;
-            trainingsSession.beginStream();
-            bool firstPage = true;
-            String sessionName = "";
-            while(trainingsSession.hasNext() && succsess) {
-                JsonBuilder builder = JsonBuilder();
-                builder.startObject();
-                builder.addKey("user");
-                builder.addValue(username);
-                if(!firstPage) {
-                    builder.addKey("sessionName");
-                    builder.addValue(sessionName);
-                }
-                builder.addKey("triggers");
-                builder.startArray();
-                size_t currentSize = 0;
-                while (trainingsSession.hasNext() && currentSize < maxTriggersPerRequest) {
-                    Trigger trigger = trainingsSession.next();
-                    builder.startObject();
-                    builder.addKey("triggerType");
-                    builder.addValue(trigger.triggerType);
-                    builder.addKey("timeMs");
-                    builder.addValue(trigger.timeMs);
-                    builder.addKey("millimeters");
-                    builder.addValue(trigger.millimeters);
-                    builder.endObject();
-                    currentSize++;
-                }
-                builder.endArray();
-                builder.endObject();
-                int httpResponseCode = http.POST(builder.getJson());
-                if (httpResponseCode == 200) {
-                    sessionName = http.getString();
-                    firstPage = false;
-                    Serial.println("Response from roller results: " + sessionName);
-                    sprintf(uploadPopupMessage, "Uploaded %i/%i", trainingsID, spiffsLogic.getTrainingsMetas().getSize());
-                    uiManager.handle(true);
-                } else {
-                    sprintf(uploadPopupMessage, "Upload error: %i", httpResponseCode);
-                    uiManager.handle(true);
-                    Serial.printf("Error during upload request. Error code: %i abording upload process\n", httpResponseCode);
-                    succsess = false;
-                }
-            }
-            if(succsess) {
-                uploadedFiles.pushBack(trainingsMeta.fileName);
-            } else {
-                break;
-            }
-            trainingsID++;
+/**
+ * Cloud upload runs in its own low priority task so timing, radio and the web server keep running.
+ * Progress is checkpointed per request, so a failed or interrupted upload resumes where it stopped.
+ * Build with -DCLOUD_UPLOAD_URL=\"http://<pc>:8080/\" to test against cloud_upload_standin.py
+ */
+#ifndef CLOUD_UPLOAD_URL
+#define CLOUD_UPLOAD_URL "https://www.roller-results.com/api/index.php?uploadResults=1"
+#endif
+#define CLOUD_UPLOAD_TRIGGERS_PER_REQUEST 100
+#define CLOUD_UPLOAD_BODY_SIZE (CLOUD_UPLOAD_TRIGGERS_PER_REQUEST * 60 + 512) // trigger objects are at most 57 chars
+#define CLOUD_UPLOAD_PAUSE_MS 50 // between requests
+#define CLOUD_UPLOAD_TASK_PRIORITY 1 // same as the loop, but on the other core
+#define CLOUD_UPLOAD_TASK_CORE 0 // next to the WiFi stack, away from the loop on ARDUINO_RUNNING_CORE
+#define CLOUD_UPLOAD_TASK_STACK 10240 // TLS needs most of it
+#define CLOUD_UPLOAD_CHECKPOINT_FILE "/upload.chk"
+#define CLOUD_UPLOAD_NAME_SIZE 48
+
+struct CloudUploadCheckpoint {
+    char fileName[CLOUD_UPLOAD_NAME_SIZE]; // empty = nothing in progress
+    uint32_t triggersUploaded;
+    char sessionName[CLOUD_UPLOAD_NAME_SIZE]; // returned by the server. Empty before the first request
+};
+
+/**
+ * Everything the task needs, copied on the loop
+ */
+struct CloudUploadJob {
+    DoubleLinkedList<String> fileNames;
+    String username;
+};
+
+TaskHandle_t cloudUploadTaskHandle = nullptr;
+volatile bool cloudUploadTaskFinished = false;
+volatile uint32_t cloudUploadStatusVersion = 0; // incremented with every uploadPopupMessage change
+
+CloudUploadCheckpoint readCloudUploadCheckpoint() {
+    CloudUploadCheckpoint checkpoint = {};
+    File file = SPIFFS.open(CLOUD_UPLOAD_CHECKPOINT_FILE, FILE_READ, false);
+    if(!file || file.read((uint8_t*) &checkpoint, sizeof(checkpoint)) != sizeof(checkpoint)) {
+        checkpoint = {};
+    }
+    file.close();
+    checkpoint.fileName[CLOUD_UPLOAD_NAME_SIZE - 1] = 0;
+    checkpoint.sessionName[CLOUD_UPLOAD_NAME_SIZE - 1] = 0;
+    return checkpoint;
+}
+
+void writeCloudUploadCheckpoint(const CloudUploadCheckpoint& checkpoint) {
+    File file = SPIFFS.open(CLOUD_UPLOAD_CHECKPOINT_FILE, FILE_WRITE, true);
+    if(!file || file.write((const uint8_t*) &checkpoint, sizeof(checkpoint)) != sizeof(checkpoint)) {
+        Serial.println("Failed to write upload checkpoint");
+    }
+    file.close();
+}
+
+void setCloudUploadStatus(const char* format, int a, int b = 0) {
+    snprintf(uploadPopupMessage, sizeof(uploadPopupMessage), format, a, b);
+    cloudUploadStatusVersion++;
+}
+
+/**
+ * Uploads one session from the checkpoint on. One keep-alive connection is used for all requests
+ * @return false on any error
+ */
+bool uploadSession(HTTPClient& http, char* body, const String& user, const String& fileName, CloudUploadCheckpoint& checkpoint) {
+    TrainingsSession session = spiffsLogic.getTraining(fileName);
+    if(!session.fileExists()) return true; // deleted meanwhile
+    if(fileName != checkpoint.fileName) {
+        checkpoint = {};
+        strlcpy(checkpoint.fileName, fileName.c_str(), CLOUD_UPLOAD_NAME_SIZE);
+    } else {
+        Serial.printf("Resuming upload of %s after %u triggers\n", fileName.c_str(), checkpoint.triggersUploaded);
+    }
+    session.beginStream();
+    session.skip(checkpoint.triggersUploaded);
+    bool succsess = true;
+    while(session.hasNext()) {
+        JsonBuilder builder = JsonBuilder(body, CLOUD_UPLOAD_BODY_SIZE);
+        builder.startObject();
+        builder.addKey("user");
+        builder.addValue(user);
+        if(checkpoint.sessionName[0]) {
+            builder.addKey("sessionName");
+            builder.addValue(checkpoint.sessionName);
         }
+        builder.addKey("triggers");
+        builder.startArray();
+        size_t count = 0;
+        while(session.hasNext() && count < CLOUD_UPLOAD_TRIGGERS_PER_REQUEST) {
+            Trigger trigger = session.next();
+            builder.startObject();
+            builder.addKey("triggerType");
+            builder.addValue(int(trigger.triggerType));
+            builder.addKey("timeMs");
+            builder.addValue(int(trigger.timeMs));
+            builder.addKey("millimeters");
+            builder.addValue(int(trigger.millimeters));
+            builder.endObject();
+            count++;
+        }
+        builder.endArray();
+        builder.endObject();
+        if(builder.overflowed()) {
+            Serial.println("Upload body too large");
+            succsess = false;
+            break;
+        }
+        int httpResponseCode = http.POST((uint8_t*) body, builder.length());
+        if(httpResponseCode != 200) {
+            setCloudUploadStatus("Upload error: %i", httpResponseCode);
+            Serial.printf("Error during upload request. Error code: %i abording upload process\n", httpResponseCode);
+            succsess = false;
+            break;
+        }
+        String sessionName = http.getString();
+        Serial.println("Response from roller results: " + sessionName);
+        strlcpy(checkpoint.sessionName, sessionName.c_str(), CLOUD_UPLOAD_NAME_SIZE);
+        checkpoint.triggersUploaded += count;
+        writeCloudUploadCheckpoint(checkpoint);
+        vTaskDelay(pdMS_TO_TICKS(CLOUD_UPLOAD_PAUSE_MS)); // let everything else catch up
+    }
+    session.endStream();
+    if(succsess) {
+        checkpoint = {};
+        writeCloudUploadCheckpoint(checkpoint); // file names are reused after deletion
+    }
+    return succsess;
+}
+
+void cloudUploadTask(void* parameter) {
+    CloudUploadJob* job = (CloudUploadJob*) parameter;
+    char* body = (char*) malloc(CLOUD_UPLOAD_BODY_SIZE);
+    Serial.printf("Uploading %i sessions to: %s with user: %s\n", job->fileNames.getSize(), CLOUD_UPLOAD_URL, job->username.c_str());
+    HTTPClient http;
+    http.setReuse(true);
+    http.begin(CLOUD_UPLOAD_URL);
+    http.addHeader("Content-Type", "application/json");
+    CloudUploadCheckpoint checkpoint = readCloudUploadCheckpoint();
+    bool succsess = body != nullptr;
+    int uploaded = 0;
+    for (auto &&fileName : job->fileNames) {
+        if(!succsess) break;
+        Serial.printf("Uploading %s\n", fileName.c_str());
+        succsess = uploadSession(http, body, job->username, fileName, checkpoint);
         if(succsess) {
-            for (auto &&fileName : uploadedFiles) {
-                if(spiffsLogic.deleteSession(fileName)) {
-                    Serial.printf("Deleted %s\n", fileName);
-                } else {
-                    Serial.printf("Could not delete session %s\n", fileName);
-                }
-            }
-            sprintf(uploadPopupMessage, "Upload done");
+            queueSessionDelete(fileName, portMAX_DELAY);
+            setCloudUploadStatus("Uploaded %i/%i", ++uploaded, job->fileNames.getSize());
         }
-        http.end();
+    }
+    if(succsess) {
+        setCloudUploadStatus("Upload done", 0);
+    }
+    http.end();
+    free(body);
+    delete job;
+    cloudUploadTaskFinished = true;
+    vTaskDelete(nullptr);
+}
+
+void startCloudUploadTask() {
+    Serial.printf("Successfully connected to %s!\n", uploadWifiSSID.c_str());
+    CloudUploadJob* job = new CloudUploadJob();
+    job->username = username;
+    for (auto &&trainingsMeta : spiffsLogic.getTrainingsMetas()) {
+        if(trainingsMeta.isRunning) continue;
+        job->fileNames.pushBack(trainingsMeta.fileName);
+    }
+    cloudUploadTaskFinished = false;
+    setCloudUploadStatus("Cloud upload..", 0);
+    uiManager.popup(uploadPopupMessage);
+    xTaskCreatePinnedToCore(cloudUploadTask, "cloudUpload", CLOUD_UPLOAD_TASK_STACK, job, CLOUD_UPLOAD_TASK_PRIORITY, &cloudUploadTaskHandle, CLOUD_UPLOAD_TASK_CORE);
+}
+
+/**
+ * Loop side. Waits for WiFi, starts the task and follows its progress
+ * @return true when finished
+ */
+bool handleCloudUpload() {
+    if(cloudUploadTaskHandle) {
+        static uint32_t shownStatusVersion = 0;
+        bool finished = cloudUploadTaskFinished;
+        deleteQueuedSessions();
+        if(shownStatusVersion != cloudUploadStatusVersion) {
+            shownStatusVersion = cloudUploadStatusVersion;
+            uiManager.popup(uploadPopupMessage);
+        }
+        if(!finished) return false;
+        cloudUploadTaskHandle = nullptr;
         return true;
+    }
+    if(WiFi.status() == WL_CONNECTED) {
+        startCloudUploadTask();
+        return false;
     } else if(millis() - cloudUploadStart > 5000) {
-        Serial.printf("Could not connect to %s!\n", uploadWifiSSID);
+        Serial.printf("Could not connect to %s!\n", uploadWifiSSID.c_str());
         return true;
     }
     return false;
 }
 
 void tryInitUpload() {
+    if(cloudUploadRunning) return;
     if(uploadWifiSSID.length() < 2) {
         uiManager.popup("Setup on website first!");
         return;
@@ -716,9 +1559,14 @@ void handleWiFi() {
     if(cloudUploadRunning) {
         cloudUploadRunning = !handleCloudUpload();
     }
-    static size_t lastTriggerCount = 0;
-    if(spiffsLogic.getActiveTraining().getTriggerCount() > lastTriggerCount) {
-        resolveLiveRequests(spiffsLogic.getActiveTraining().getTriggerCount() - lastTriggerCount);
-        lastTriggerCount = spiffsLogic.getActiveTraining().getTriggerCount();
+    handleControlSocket();
+    deleteQueuedSessions();
+    if(spiffsLogic.getSessionListVersion() != sessionCatalogVersion) {
+        publishSessionCatalog();
+    } else if(spiffsLogic.getActiveSessionSize() != activeSessionSize) {
+        publishActiveSessionSize();
+    }
+    if(isLiveUpdatePending()) {
+        resolveLiveRequests();
     }
 }
\ No newline at end of file
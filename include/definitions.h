@@ -55,11 +55,38 @@
  *  Other definitions
  */
 #define RADIO_STANDBY_TIME_US 5000
+#define RADIO_TX_DONE_TIMEOUT_MS 1000 // sending again without the tx done interrupt after this
+
+/**
+ * Radio channel plan
+ * Every timing system (one display and its stations) uses one network (frequency + sync word).
+ * Network 0 is the legacy 868MHz setup. It is also the join channel where displays announce their network
+ */
+#define RADIO_NETWORK_COUNT 8
+#define RADIO_NETWORK_JOIN 0
+#define RADIO_FRAME_HEADER_SIZE 1 // first byte of every frame is the network id
+#define RADIO_FRAME_BEACON 0xF0 // header of join beacons sent on the join channel
+#define RADIO_JOIN_LISTEN_MS 6000 // longer than the beacon interval so every display in range is heard
+#define RADIO_SCAN_MS_PER_NETWORK 1500
+
+#define MASTER_TRIGGER_MAX_AHEAD_MS 15000 // station triggers further in the future come from a broken time sync
+#define MASTER_TRIGGER_MAX_AGE_MS (12 * 3600000) // station outboxes are replayed after outages of up to this long
+#define RADIO_MAX_FRAME_SIZE 40 // own frames are at most 33 bytes (4 batched triggers). Larger ones are foreign and dropped
+#define RADIO_RECEIVE_QUEUE_LENGTH 16
+#define RADIO_RECEIVE_TASK_PRIORITY 5 // above loop() so DIO1 is served while the loop blocks on I2C or flash
+#define RADIO_RECEIVE_TASK_STACK 4096
 
 #define NUM_LEDS_DISPLAY 8 * 32
 #define NUM_LEDS_LASER 4
-#define MAX_AMPS_PER_PIXEL 0.05
-#define MAX_CONTINUOUS_AMPS 0.5 // should give approx 20 - 24h of battery life on a 12Wh battery
+#define LED_FRAME_MS 33 // 30 fps
+#define LED_REFRESH_MS 1000 // unchanged frames are sent again after this
+#define MAX_MILLIAMPS_PER_PIXEL 50 // all three channels at 255
+#define MAX_CONTINUOUS_MILLIAMPS 500 // peak limit. The average is governed by the battery life setting
+#define LED_BATTERY_MAH 2400 // 12Wh battery at the 5V of the LEDs
+#define LED_BATTERY_LIFE_DEFAULT_H 16 // does not limit the default brightness
+#define LED_MIN_MILLIAMPS 20 // the governor does not limit below this
+#define LED_AVERAGE_FRAMES 1800 // one minute of LED frames in the average draw
+#define LED_GOVERNOR_STEP_FRAMES 10 // the limit moves 1mA per this many frames
 
 
 #define MAX_CONNECTIONS 50
\ No newline at end of file
@@ -2,32 +2,96 @@
 
 #include <Global.h>
 #include <MasterSlaveLogic.h>
+#include <RadioCapture.h>
+#include <Scheduler.h>
 
-timeMs_t sendTimeout = 0;
+timeMs_t sendTimeout = 0; // airtime of the last frame sent
 
-void radioReceived(const uint8_t* byteArr, size_t size);
+void radioReceived(const uint8_t* byteArr, size_t size, timeMs_t receivedMs);
+void writePreferences();
+
+/**
+ * Channel plan. Index = network id. Network 0 stays compatible with the old fixed 868MHz setup
+ */
+const float radioNetworkFrequencies[RADIO_NETWORK_COUNT] = { 868.0, 865.2, 865.6, 866.0, 866.4, 866.8, 867.2, 867.6 };
+const uint8_t radioNetworkSyncWords[RADIO_NETWORK_COUNT] = { RADIOLIB_SX126X_SYNC_WORD_PRIVATE, 0x22, 0x42, 0x52, 0x62, 0x72, 0x82, 0x92 };
 
 timeMs_t lastSend = 0;
 timeMs_t receiveTimeout = 0;
 
 struct SceduledSend {
     size_t size;
-    uint8_t data[10];
+    uint8_t data[RADIO_MAX_FRAME_SIZE];
 };
 
 DoubleLinkedList<SceduledSend> sceduledSends = DoubleLinkedList<SceduledSend>();
 
 bool timeSyncRequested = false;
+bool beaconRequested = false;
+
+timeMs_t radioRestoreNetworkMs = 0; // set while a beacon is on air on the join channel
+timeMs_t radioJoinUntil = 0; // set while a station is looking for a display
+int16_t radioJoinBestNetwork = -1;
+float radioJoinBestRssi = -1000;
+char radioPopupMessage[25];
+
+/**
+ * A frame as read by the receive task. receivedMs is taken right after DIO1, not when the loop gets to it
+ */
+struct RadioFrame {
+  timeMs_t receivedMs;
+  float rssi;
+  uint8_t size;
+  uint8_t data[RADIO_MAX_FRAME_SIZE];
+};
+
+TaskHandle_t radioReceiveTaskHandle = nullptr;
+QueueHandle_t radioReceiveQueue = nullptr;
+SemaphoreHandle_t radioMutex = nullptr; // guards the SPI bus between loop() and the receive task
+volatile bool radioTransmitting = false; // next DIO1 is a tx done, not a packet
+volatile uint32_t radioOverruns = 0; // frames lost because the queue was full or DIO1 fired again before the buffer was read
+volatile uint32_t radioCrcErrors = 0;
+
+void radioReceiveTask(void* parameter);
+
+void lockRadio() {
+  xSemaphoreTakeRecursive(radioMutex, portMAX_DELAY);
+}
+
+void unlockRadio() {
+  xSemaphoreGiveRecursive(radioMutex);
+}
+
+/**
+ * Starts a transmission. The receive task re-arms receive once it is done
+ */
+int16_t radioTransmit(const uint8_t* data, size_t size) {
+  lockRadio();
+  radioTransmitting = true;
+  int16_t statusCode = radio.startTransmit(data, size);
+  if(statusCode != RADIOLIB_ERR_NONE) {
+    radioTransmitting = false;
+  }
+  unlockRadio();
+  sendTimeout = radio.getTimeOnAir(size) / 1000;
+  lastSend = millis();
+  captureRadioFrame(RADIO_CAPTURE_TX, data, size, 0, 0);
+  return statusCode;
+}
 
+/**
+ * Prepends the network header
+ */
 void sceduleSend(const uint8_t* data, size_t size) {
-    if(size > 10) {
+    if(size + RADIO_FRAME_HEADER_SIZE > RADIO_MAX_FRAME_SIZE) {
       Serial.println("Sceduled too large packet");
       return;
     }
     Serial.printf("secduling size %i\n", size);
     SceduledSend sceduledSend;
-    memcpy(sceduledSend.data, data, size);
-    sceduledSend.size = size;
+    sceduledSend.data[0] = radioNetwork;
+    memcpy(sceduledSend.data + RADIO_FRAME_HEADER_SIZE, data, size);
+    sceduledSend.size = size + RADIO_FRAME_HEADER_SIZE;
     sceduledSends.pushBack(sceduledSend);
 }
 
@@ -35,11 +99,122 @@ void sceduleTimeSync() {
   timeSyncRequested = true;
 }
 
+/**
+ * Announce this displays network on the join channel
+ */
+void sceduleBeacon() {
+  beaconRequested = true;
+}
+
+void setRadioChannel(uint8_t network) {
+  lockRadio();
+  radio.standby();
+  radioTransmitting = false;
+  radio.setFrequency(radioNetworkFrequencies[network]);
+  radio.setSyncWord(radioNetworkSyncWords[network]);
+  unlockRadio();
+}
+
+void applyRadioNetwork(uint8_t network) {
+  if(network >= RADIO_NETWORK_COUNT) network = RADIO_NETWORK_JOIN;
+  radioNetwork = network;
+  lockRadio();
+  setRadioChannel(network);
+  radio.startReceive();
+  unlockRadio();
+  Serial.printf("Radio network %i (%.1fMHz)\n", network + 1, radioNetworkFrequencies[network]);
+}
+
+bool isRadioJoining() {
+  return radioJoinUntil != 0;
+}
+
+/**
+ * Stations only. Listens on the join channel for beacons and takes the strongest display
+ */
+void startRadioNetworkJoin() {
+  radioJoinUntil = millis() + RADIO_JOIN_LISTEN_MS;
+  radioJoinBestNetwork = -1;
+  radioJoinBestRssi = -1000;
+  lockRadio();
+  setRadioChannel(RADIO_NETWORK_JOIN);
+  radio.startReceive();
+  unlockRadio();
+  Serial.println("Looking for displays");
+}
+
+/**
+ * Displays only. Counts LoRa activity on every network and returns the least busy one.
+ * The join channel is skipped as it carries the beacons of all systems.
+ * @note Blocking for RADIO_SCAN_MS_PER_NETWORK per network
+ */
+uint8_t findFreeRadioNetwork() {
+  uint8_t bestNetwork = radioNetwork;
+  uint32_t bestBusyCount = UINT32_MAX;
+  lockRadio();
+  radio.clearDio1Action(); // scanChannel polls DIO1 itself
+  for (uint8_t network = RADIO_NETWORK_JOIN + 1; network < RADIO_NETWORK_COUNT; network++) {
+    setRadioChannel(network);
+    uint32_t busyCount = 0;
+    timeMs_t scanStart = millis();
+    while(millis() - scanStart < RADIO_SCAN_MS_PER_NETWORK) {
+      if(radio.scanChannel() == RADIOLIB_LORA_DETECTED) {
+        busyCount++;
+      }
+    }
+    Serial.printf("Network %i: %i detections\n", network + 1, busyCount);
+    if(busyCount < bestBusyCount) {
+      bestBusyCount = busyCount;
+      bestNetwork = network;
+    }
+  }
+  radio.setDio1Action(setFlag);
+  unlockRadio();
+  applyRadioNetwork(radioNetwork); // restore until the caller applies the result
+  return bestNetwork;
+}
+
+void radioBeaconReceived(const uint8_t* byteArr, size_t size, float rssi) {
+  if(!isRadioJoining() || size < 1) return;
+  uint8_t network = byteArr[0];
+  if(network >= RADIO_NETWORK_COUNT) return;
+  Serial.printf("Beacon from network %i (rssi: %.0f)\n", network + 1, rssi);
+  if(rssi > radioJoinBestRssi) {
+    radioJoinBestRssi = rssi;
+    radioJoinBestNetwork = network;
+  }
+}
+
+/**
+ * Restores the network after beacons and finishes joins
+ */
+void handleRadioNetwork() {
+  if(radioRestoreNetworkMs && millis() > radioRestoreNetworkMs) {
+    radioRestoreNetworkMs = 0;
+    applyRadioNetwork(radioNetwork);
+  }
+  if(isRadioJoining() && millis() > radioJoinUntil) {
+    radioJoinUntil = 0;
+    if(radioJoinBestNetwork >= 0) {
+      applyRadioNetwork(radioJoinBestNetwork);
+      radioNetworkInput->setValue(radioNetwork + 1);
+      writePreferences();
+      sprintf(radioPopupMessage, "Joined network %i", radioNetwork + 1);
+    } else {
+      applyRadioNetwork(radioNetwork);
+      sprintf(radioPopupMessage, "No display found");
+    }
+    uiManager.popup(radioPopupMessage);
+  }
+}
+
 int64_t timeForSize(uint8_t size) {
   return radio.getTimeOnAir(size);
 }
 
 void beginRadio() {
+  radioMutex = xSemaphoreCreateRecursiveMutex();
+  radioReceiveQueue = xQueueCreate(RADIO_RECEIVE_QUEUE_LENGTH, sizeof(RadioFrame));
   SPI.begin(LoRa_SCK, LoRa_MISO, LoRa_MOSI, LoRa_nss);
 
   Serial.print(F("[SX1262] Initializing ... "));
@@ -49,8 +224,6 @@ void beginRadio() {
   // radio.setBandwidth(250);
   // radio.setPreambleLength(4);
   radio.setOutputPower(22); // 10 => 10mW, max: 22 => 158mW
-  sendTimeout = radio.getTimeOnAir(sizeof(Trigger) * 2) / 1000;
-  Serial.printf("Radio send timeout: %ims\n", sendTimeout);
   if (error == RADIOLIB_ERR_NONE) {
     Serial.println(F("success!"));
   } else {
@@ -69,56 +242,112 @@ void beginRadio() {
     Serial.println(error);
     while (true);
   }
+  xTaskCreatePinnedToCore(radioReceiveTask, "radioReceive", RADIO_RECEIVE_TASK_STACK, nullptr, RADIO_RECEIVE_TASK_PRIORITY, &radioReceiveTaskHandle, ARDUINO_RUNNING_CORE);
 }
 
 // this function is called when a complete packet is received or transmitted
 ICACHE_RAM_ATTR void setFlag(void) {
-  receivedFlag = true;
+  if(radioReceiveTaskHandle == nullptr) return;
+  BaseType_t higherPriorityTaskWoken = pdFALSE;
+  vTaskNotifyGiveFromISR(radioReceiveTaskHandle, &higherPriorityTaskWoken);
+  portYIELD_FROM_ISR(higherPriorityTaskWoken);
 }
 
-void handleRadioReceive() {
-  if(receivedFlag) {
-    // Serial.println("Received");
-    receivedFlag = false;
-    uint8_t byteArr[255];
-    int error = radio.readData(byteArr, 255);
-    size_t size = radio.getPacketLength();
-    // Serial.printf("received %i bytes\n", size);
-    if(size > 0 && size) {
-      if(error == RADIOLIB_ERR_NONE) {
-        if(millis() > receiveTimeout) {
-          Serial.printf("Received (len=%i)\n", size);
-          radioReceived(byteArr, size);
-        }
-      } else if (error == RADIOLIB_ERR_CRC_MISMATCH) {
-        Serial.println(F("CRC error!"));
+/**
+ * Wakes on DIO1, reads the radio buffer and re-arms receive before anything else can overwrite it
+ */
+void radioReceiveTask(void* parameter) {
+  while(true) {
+    uint32_t notifications = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    lockRadio();
+    if(radioTransmitting) {
+      radioTransmitting = false;
+      notifications--;
+    } else {
+      RadioFrame frame;
+      frame.receivedMs = millis();
+      size_t size = radio.getPacketLength();
+      int error = radio.readData(frame.data, min(size, size_t(RADIO_MAX_FRAME_SIZE)));
+      frame.rssi = radio.getRSSI();
+      captureRadioFrame(error == RADIOLIB_ERR_CRC_MISMATCH ? RADIO_CAPTURE_CRC_ERROR : 0, frame.data, size, frame.rssi, radio.getSNR());
+      notifications--;
+      if(error == RADIOLIB_ERR_CRC_MISMATCH) {
+        radioCrcErrors++;
+      } else if(error != RADIOLIB_ERR_NONE) {
+        Serial.printf("Radio read failed, code %i\n", error);
+      } else if(size > RADIO_MAX_FRAME_SIZE) {
+        Serial.printf("Dropped oversized frame (len=%i)\n", size);
       } else {
-        // some other error occurred
-        Serial.print(F("failed, code "));
-        Serial.println(error);
+        frame.size = size;
+        if(xQueueSend(radioReceiveQueue, &frame, 0) != pdTRUE) {
+          radioOverruns++;
+        }
       }
     }
+    radioOverruns += notifications; // packets that arrived before the previous one was read
     radio.startReceive();
+    unlockRadio();
+    wakeScheduler(SCHEDULER_EVENT_RADIO);
+  }
+}
+
+void handleRadioReceive() {
+  RadioFrame frame;
+  while(xQueueReceive(radioReceiveQueue, &frame, 0) == pdTRUE) {
+    if(frame.size <= RADIO_FRAME_HEADER_SIZE || frame.receivedMs <= receiveTimeout) continue;
+    Serial.printf("Received (len=%i)\n", frame.size);
+    const uint8_t header = frame.data[0];
+    const uint8_t* payload = frame.data + RADIO_FRAME_HEADER_SIZE;
+    const size_t payloadSize = frame.size - RADIO_FRAME_HEADER_SIZE;
+    if(header == RADIO_FRAME_BEACON) {
+      radioBeaconReceived(payload, payloadSize, frame.rssi);
+    } else if(header != radioNetwork || isRadioJoining()) {
+      Serial.printf("Dropped frame of network %i\n", header + 1);
+    } else {
+      radioReceived(payload, payloadSize, frame.receivedMs);
+    }
   }
 }
 
+/**
+ * @return true if the last frame is off air. A tx done that never arrives only blocks for RADIO_TX_DONE_TIMEOUT_MS
+ */
+bool isRadioSendFree() {
+  if(millis() - lastSend <= sendTimeout) return false;
+  return !radioTransmitting || millis() - lastSend > sendTimeout + RADIO_TX_DONE_TIMEOUT_MS;
+}
+
 void handleRadioSend() {
-  if(timeSyncRequested && millis() - lastSend > sendTimeout) {
+  handleRadioNetwork();
+  if(radioRestoreNetworkMs || isRadioJoining()) return; // not on our own network right now
+  if(timeSyncRequested && isRadioSendFree()) {
+    uint8_t frame[RADIO_FRAME_HEADER_SIZE + sizeof(uint32_t)];
     uint32_t time = millis();
-    int16_t statusCode = radio.startTransmit((uint8_t*) &time, sizeof(uint32_t));
+    frame[0] = radioNetwork;
+    memcpy(frame + RADIO_FRAME_HEADER_SIZE, &time, sizeof(uint32_t));
+    int16_t statusCode = radioTransmit(frame, sizeof(frame));
     timeSyncRequested = false;
-    receiveTimeout = millis() + radio.getTimeOnAir(sizeof(uint32_t)) / 1000 + 30;
-    lastSend = millis();
+    receiveTimeout = millis() + radio.getTimeOnAir(sizeof(frame)) / 1000 + 30;
     Serial.printf("Sended time sync. status code: %i\n", statusCode);
     return;
   }
-  if(sceduledSends.getSize() > 0 && millis() - lastSend > sendTimeout) {
+  if(beaconRequested && isRadioSendFree()) {
+    uint8_t beacon[RADIO_FRAME_HEADER_SIZE + 1] = { RADIO_FRAME_BEACON, radioNetwork };
+    lockRadio();
+    setRadioChannel(RADIO_NETWORK_JOIN);
+    radioTransmit(beacon, sizeof(beacon));
+    unlockRadio();
+    beaconRequested = false;
+    radioRestoreNetworkMs = millis() + radio.getTimeOnAir(sizeof(beacon)) / 1000 + 10;
+    receiveTimeout = radioRestoreNetworkMs + 30;
+    return;
+  }
+  if(sceduledSends.getSize() > 0 && isRadioSendFree()) {
       SceduledSend& sceduledSend = sceduledSends.getFirst();
       Serial.printf("Expected time on air: %ims, size: %i\n", radio.getTimeOnAir(sceduledSend.size) / 1000, sceduledSend.size);
-      radio.startTransmit(sceduledSend.data, sceduledSend.size);
+      radioTransmit(sceduledSend.data, sceduledSend.size);
       receiveTimeout = millis() + radio.getTimeOnAir(sceduledSend.size) / 1000 + 30;
       sceduledSends.removeIndex(0);
-      lastSend = millis();
       Serial.println("Sending");
   }
 }
\ No newline at end of file
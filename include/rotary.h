@@ -1,11 +1,13 @@
 #pragma once
 
 #include <Global.h>
+#include <Scheduler.h>
 
 void RotaryChanged() {
   const unsigned int state = Rotary.GetState();
   if (state & DIR_CW) Counter++;
   if (state & DIR_CCW) Counter--;
+  if (state & (DIR_CW | DIR_CCW)) wakeSchedulerFromISR(SCHEDULER_EVENT_INPUT);
 }
 
 void handleRotary() {
@@ -15,6 +15,7 @@
 #include <MasterSlaveLogic.h>
 #include <SPIFFSLogic.h>
 #include <GuiLogic.h>
+#include <Scheduler.h>
 
 bool startgunStarted = false;
 
@@ -28,6 +29,18 @@ timeMs_t startgunLastBeep = 0;
 
 timeMs_t startgunClearPopup = INT32_MAX;
 
+void handleStartgun();
+
+/**
+ * Lets the scheduler run handleStartgun as soon as millis() passes timeMs instead of up to one period later.
+ * The go trigger and the go sound depend on it
+ */
+void wakeStartgunAfter(timeMs_t timeMs) {
+    const timeMs_t nowMs = millis();
+    const uint32_t delayMs = timeMs >= nowMs ? timeMs - nowMs + 1 : 0;
+    setSchedulerTaskDue(handleStartgun, micros() + delayMs * 1000);
+}
+
 double randomDouble(double minRand, double maxRand) {
     return minRand + (maxRand - minRand) * random(100000) / 100000.0;
 }
@@ -38,6 +51,7 @@ void triggerStartGun() {
     startgunInPositionMs = millis() + inPositionDelay->getValue() * 1000;
     startgunSetMs = startgunInPositionMs + setMinDelay->getValue() * 1000 + (setMaxDelay->getValue() - setMinDelay->getValue()) * 1000.0 * randomDouble(0, 1);
     startgunGoMs = startgunSetMs + goMinDelay->getValue() * 1000 + (goMaxDelay->getValue() - goMinDelay->getValue()) * 1000.0 * randomDouble(0, 1);
+    wakeStartgunAfter(startgunInPositionMs);
     // startgunStarted = true;
     // playSoundStartgunIdle();
     // uiManager.popup("Go to the start!");
@@ -88,6 +102,11 @@ void handleStartgun() {
             break;
         }
     }
+    switch(startgunPhase) {
+        case 1: wakeStartgunAfter(startgunInPositionMs); break;
+        case 2: wakeStartgunAfter(startgunSetMs); break;
+        case 3: wakeStartgunAfter(startgunGoMs); break;
+    }
     if(millis() > startgunClearPopup) {
         uiManager.popup(nullptr);
         startgunClearPopup = UINT32_MAX;
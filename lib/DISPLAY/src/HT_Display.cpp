@@ -9,15 +9,24 @@ ScreenDisplay::ScreenDisplay() {
 	geometry = GEOMETRY_128_64;
 	textAlignment = TEXT_ALIGN_LEFT;
 	fontData = ArialMT_Plain_10;
+	glyphs = NULL; // decoded on the first setFont()
+	memset(glyphCacheFonts, 0, sizeof(glyphCacheFonts));
+	memset(glyphCacheTables, 0, sizeof(glyphCacheTables));
+	glyphCacheNext = 0;
 	fontTableLookupFunction = DefaultFontTableLookup;
 	buffer = NULL;
 #ifdef DISPLAY_DOUBLE_BUFFER
 	buffer_back = NULL;
+	dirtyTiles = NULL;
+	inkedTiles = NULL;
 #endif
 }
 
 ScreenDisplay::~ScreenDisplay() {
   end();
+  for (uint8_t i = 0; i < DISPLAY_GLYPH_CACHE_FONTS; i++) {
+    free(glyphCacheTables[i]);
+  }
 }
 
 bool ScreenDisplay::init() {
@@ -63,6 +72,19 @@ bool ScreenDisplay::init() {
     return false;
   }
   }
+  if(this->dirtyTiles==NULL && displayType==OLED) {
+    // without the maps every tile is compared
+    this->dirtyTiles = (uint8_t*) malloc(tileMapSize());
+    this->inkedTiles = (uint8_t*) malloc(tileMapSize());
+    if(!this->dirtyTiles || !this->inkedTiles) {
+      free(this->dirtyTiles);
+      free(this->inkedTiles);
+      this->dirtyTiles = NULL;
+      this->inkedTiles = NULL;
+    } else {
+      memset(this->inkedTiles, 0, tileMapSize());
+    }
+  }
   #endif
 
   
@@ -77,6 +99,10 @@ void ScreenDisplay::end() {
   if (this->buffer && displayType==OLED) { free(this->buffer - getBufferOffset()); this->buffer = NULL; }
   #ifdef DISPLAY_DOUBLE_BUFFER
   if (this->buffer_back && displayType==OLED) { free(this->buffer_back - getBufferOffset()); this->buffer_back = NULL; }
+  free(this->dirtyTiles);
+  free(this->inkedTiles);
+  this->dirtyTiles = NULL;
+  this->inkedTiles = NULL;
   #endif
   if (this->logBuffer != NULL) { free(this->logBuffer); this->logBuffer = NULL; }
   if(this->rst!=-1)
@@ -91,9 +117,27 @@ void ScreenDisplay::resetDisplay(void) {
   if(displayType==OLED)
       memset(buffer_back, 1, displayBufferSize);
   #endif
+  markAllTilesDirty();
   display();
 }
 
+void ScreenDisplay::markTiles(uint16_t from, uint16_t to) {
+#ifdef DISPLAY_DOUBLE_BUFFER
+  if (!dirtyTiles) return;
+  for (uint16_t tile = from >> 3; tile <= (to >> 3); tile++) {
+    dirtyTiles[tile >> 3] |= 1 << (tile & 7);
+    inkedTiles[tile >> 3] |= 1 << (tile & 7);
+  }
+#endif
+}
+
+void ScreenDisplay::markAllTilesDirty() {
+#ifdef DISPLAY_DOUBLE_BUFFER
+  if (!dirtyTiles) return;
+  memset(dirtyTiles, 0xFF, tileMapSize());
+#endif
+}
+
 void ScreenDisplay::setColor(DISPLAY_COLOR color) {
   this->color = color;
 }
@@ -104,6 +148,7 @@ DISPLAY_COLOR ScreenDisplay::getColor() {
 
 void ScreenDisplay::setPixel(int16_t x, int16_t y) {
   if (x >= 0 && x < this->width() && y >= 0 && y < this->height()) {
+    markTile(x + (y >> 3) * this->width());
     switch (color) {
       case WHITE:   buffer[x + (y >> 3) * this->width()] |=  (1 << (y & 7)); break;
       case BLACK:   buffer[x + (y >> 3) * this->width()] &= ~(1 << (y & 7)); break;
@@ -114,6 +159,7 @@ void ScreenDisplay::setPixel(int16_t x, int16_t y) {
 
 void ScreenDisplay::setPixelColor(int16_t x, int16_t y, DISPLAY_COLOR color) {
   if (x >= 0 && x < this->width() && y >= 0 && y < this->height()) {
+    markTile(x + (y >> 3) * this->width());
     switch (color) {
       case WHITE:   buffer[x + (y >> 3) * this->width()] |=  (1 << (y & 7)); break;
       case BLACK:   buffer[x + (y >> 3) * this->width()] &= ~(1 << (y & 7)); break;
@@ -124,6 +170,7 @@ void ScreenDisplay::setPixelColor(int16_t x, int16_t y, DISPLAY_COLOR color) {
 
 void ScreenDisplay::clearPixel(int16_t x, int16_t y) {
   if (x >= 0 && x < this->width() && y >= 0 && y < this->height()) {
+    markTile(x + (y >> 3) * this->width());
     switch (color) {
       case BLACK:   buffer[x + (y >> 3) * this->width()] |=  (1 << (y & 7)); break;
       case WHITE:   buffer[x + (y >> 3) * this->width()] &= ~(1 << (y & 7)); break;
@@ -290,6 +337,7 @@ void ScreenDisplay::drawHorizontalLine(int16_t x, int16_t y, int16_t length) {
    uint8_t * bufferPtr = buffer;
    bufferPtr += (y >> 3) * this->width();
    bufferPtr += x;
+   markTiles(bufferPtr - buffer, bufferPtr - buffer + length - 1);
   
    uint8_t drawBit = 1 << (y & 7);
   
@@ -321,6 +369,9 @@ void ScreenDisplay::drawVerticalLine(int16_t x, int16_t y, int16_t length) {
 
   if (length <= 0) return;
 
+  for (int16_t page = y >> 3; page <= (y + length - 1) >> 3; page++) {
+    markTile(x + page * this->width());
+  }
 
   uint8_t yOffset = y & 7;
   uint8_t drawBit;
@@ -442,7 +493,6 @@ void ScreenDisplay::drawIco16x16(int16_t xMove, int16_t yMove, const char *ico,
 void ScreenDisplay::drawStringInternal(int16_t xMove, int16_t yMove, char* text, uint16_t textLength, uint16_t textWidth) {
   uint8_t textHeight       = pgm_read_byte(fontData + HEIGHT_POS);
   uint8_t firstChar        = pgm_read_byte(fontData + FIRST_CHAR_POS);
-  uint16_t sizeOfJumpTable = pgm_read_byte(fontData + CHAR_NUM_POS)  * JUMPTABLE_BYTES;
 
   uint16_t cursorX         = 0;
   uint16_t cursorY         = 0;
@@ -465,38 +515,107 @@ void ScreenDisplay::drawStringInternal(int16_t xMove, int16_t yMove, char* text,
   if (xMove + textWidth  < 0 || xMove > this->width() ) {return;}
   if (yMove + textHeight < 0 || yMove > this->height() ) {return;}
 
+  uint8_t rasterHeight = 1 + ((textHeight - 1) >> 3); // fast ceil(height / 8.0)
   for (uint16_t j = 0; j < textLength; j++) {
     int16_t xPos = xMove + cursorX;
     int16_t yPos = yMove + cursorY;
 
     uint8_t code = text[j];
     if (code >= firstChar) {
-      uint8_t charCode = code - firstChar;
-
-      // 4 Bytes per char code
-      uint8_t msbJumpToChar    = pgm_read_byte( fontData + JUMPTABLE_START + charCode * JUMPTABLE_BYTES );                  // MSB  \ JumpAddress
-      uint8_t lsbJumpToChar    = pgm_read_byte( fontData + JUMPTABLE_START + charCode * JUMPTABLE_BYTES + JUMPTABLE_LSB);   // LSB /
-      uint8_t charByteSize     = pgm_read_byte( fontData + JUMPTABLE_START + charCode * JUMPTABLE_BYTES + JUMPTABLE_SIZE);  // Size
-      uint8_t currentCharWidth = pgm_read_byte( fontData + JUMPTABLE_START + charCode * JUMPTABLE_BYTES + JUMPTABLE_WIDTH); // Width
-
-      // Test if the char is drawable
-      if (!(msbJumpToChar == 255 && lsbJumpToChar == 255)) {
-        // Get the position of the char data
-        uint16_t charDataPosition = JUMPTABLE_START + sizeOfJumpTable + ((msbJumpToChar << 8) + lsbJumpToChar);
-        drawInternal(xPos, yPos, currentCharWidth, textHeight, fontData, charDataPosition, charByteSize);
+      DisplayGlyph glyph = getGlyph(code);
+      if (glyph.dataPos != 0) {
+        drawGlyph(xPos, yPos, glyph, textHeight, rasterHeight);
       }
+      cursorX += glyph.width;
+    }
+  }
+}
+
+DisplayGlyph ScreenDisplay::getGlyph(uint8_t code) {
+  uint8_t firstChar = pgm_read_byte(fontData + FIRST_CHAR_POS);
+  if (glyphs) return glyphs[code - firstChar];
+  uint8_t charCode = code - firstChar;
+  DisplayGlyph glyph = { 0, 0, 0 };
+  if (charCode >= pgm_read_byte(fontData + CHAR_NUM_POS)) return glyph;
+  // 4 Bytes per char code
+  uint8_t msbJumpToChar = pgm_read_byte( fontData + JUMPTABLE_START + charCode * JUMPTABLE_BYTES );                  // MSB  \ JumpAddress
+  uint8_t lsbJumpToChar = pgm_read_byte( fontData + JUMPTABLE_START + charCode * JUMPTABLE_BYTES + JUMPTABLE_LSB);   // LSB /
+  glyph.size            = pgm_read_byte( fontData + JUMPTABLE_START + charCode * JUMPTABLE_BYTES + JUMPTABLE_SIZE);  // Size
+  glyph.width           = pgm_read_byte( fontData + JUMPTABLE_START + charCode * JUMPTABLE_BYTES + JUMPTABLE_WIDTH); // Width
+  // Test if the char is drawable
+  if (!(msbJumpToChar == 255 && lsbJumpToChar == 255)) {
+    uint16_t sizeOfJumpTable = pgm_read_byte(fontData + CHAR_NUM_POS) * JUMPTABLE_BYTES;
+    glyph.dataPos = JUMPTABLE_START + sizeOfJumpTable + ((msbJumpToChar << 8) + lsbJumpToChar);
+  }
+  return glyph;
+}
 
-      cursorX += currentCharWidth;
+void ScreenDisplay::drawGlyph(int16_t xMove, int16_t yMove, const DisplayGlyph& glyph, int16_t textHeight, uint8_t rasterHeight) {
+  if (yMove + textHeight < 0 || yMove > this->height()) return;
+  if (xMove + glyph.width < 0 || xMove > this->width()) return;
+
+  const uint8_t *data = fontData + glyph.dataPos;
+  const uint8_t *dataEnd = data + (glyph.size == 0 ? glyph.width * rasterHeight : glyph.size);
+  const int16_t screenWidth = this->width();
+  const int16_t pages = this->height() >> 3;
+  const int16_t firstPage = yMove >> 3;
+  const uint8_t yOffset = yMove & 7;
+
+  // byte aligned fast path: glyph on whole pages and completely on screen
+  if (yOffset == 0 && color == WHITE && glyph.width > 0 && xMove >= 0 && xMove + glyph.width <= screenWidth && firstPage >= 0 && firstPage + rasterHeight <= pages) {
+    for (uint8_t page = 0; page < rasterHeight; page++) {
+      uint16_t pos = xMove + (firstPage + page) * screenWidth;
+      markTiles(pos, pos + glyph.width - 1);
+    }
+    for (uint8_t column = 0; data < dataEnd; column++) {
+      uint8_t *target = buffer + xMove + column + firstPage * screenWidth;
+      for (uint8_t row = 0; row < rasterHeight && data < dataEnd; row++) {
+        *target |= pgm_read_byte(data++);
+        target += screenWidth;
+      }
+    }
+    return;
+  }
+
+  for (int16_t x = xMove; data < dataEnd; x++) {
+    if (x < 0 || x >= screenWidth) {
+      data += rasterHeight;
+      continue;
+    }
+    int16_t page = firstPage;
+    for (uint8_t row = 0; row < rasterHeight && data < dataEnd; row++, page++) {
+      uint8_t currentByte = pgm_read_byte(data++);
+      // like drawInternal() nothing of a row starting above the screen is drawn
+      if (page < 0 || page >= pages) continue;
+      uint16_t pos = x + page * screenWidth;
+      markTile(pos);
+      switch (this->color) {
+        case WHITE:   buffer[pos] |= currentByte << yOffset; break;
+        case BLACK:   buffer[pos] &= ~(currentByte << yOffset); break;
+        case INVERSE: buffer[pos] ^= currentByte << yOffset; break;
+      }
+      if (yOffset == 0 || page + 1 >= pages) continue;
+      pos += screenWidth;
+      markTile(pos);
+      switch (this->color) {
+        case WHITE:   buffer[pos] |= currentByte >> (8 - yOffset); break;
+        case BLACK:   buffer[pos] &= ~(currentByte >> (8 - yOffset)); break;
+        case INVERSE: buffer[pos] ^= currentByte >> (8 - yOffset); break;
+      }
     }
   }
 }
 
 
 void ScreenDisplay::drawString(int16_t xMove, int16_t yMove, String strUser) {
+  drawString(xMove, yMove, strUser.c_str());
+}
+
+void ScreenDisplay::drawString(int16_t xMove, int16_t yMove, const char* strUser) {
   uint16_t lineHeight = pgm_read_byte(fontData + HEIGHT_POS);
 
-  // char* text must be freed!
-  char* text = utf8ascii(strUser);
+  char stackText[DISPLAY_STACK_TEXT_SIZE];
+  char* text = utf8ascii(strUser, stackText, sizeof(stackText));
 
   uint16_t yOffset = 0;
   // If the string should be centered vertically too
@@ -518,14 +637,19 @@ void ScreenDisplay::drawString(int16_t xMove, int16_t yMove, String strUser) {
     drawStringInternal(xMove, yMove - yOffset + (line++) * lineHeight, textPart, length, getStringWidth(textPart, length));
     textPart = strtok(NULL, "\n");
   }
-  free(text);
+  if (text != stackText) free(text);
 }
 
 void ScreenDisplay::drawStringMaxWidth(int16_t xMove, int16_t yMove, uint16_t maxLineWidth, String strUser) {
+  drawStringMaxWidth(xMove, yMove, maxLineWidth, strUser.c_str());
+}
+
+void ScreenDisplay::drawStringMaxWidth(int16_t xMove, int16_t yMove, uint16_t maxLineWidth, const char* strUser) {
   uint16_t firstChar  = pgm_read_byte(fontData + FIRST_CHAR_POS);
   uint16_t lineHeight = pgm_read_byte(fontData + HEIGHT_POS);
 
-  char* text = utf8ascii(strUser);
+  char stackText[DISPLAY_STACK_TEXT_SIZE];
+  char* text = utf8ascii(strUser, stackText, sizeof(stackText));
 
   uint16_t length = strlen(text);
   uint16_t lastDrawnPos = 0;
@@ -536,7 +660,9 @@ void ScreenDisplay::drawStringMaxWidth(int16_t xMove, int16_t yMove, uint16_t ma
   uint16_t widthAtBreakpoint = 0;
 
   for (uint16_t i = 0; i < length; i++) {
-    strWidth += pgm_read_byte(fontData + JUMPTABLE_START + (text[i] - firstChar) * JUMPTABLE_BYTES + JUMPTABLE_WIDTH);
+    if ((uint8_t) text[i] >= firstChar) {
+      strWidth += getGlyph(text[i]).width;
+    }
 
     // Always try to break on a space or dash
     if (text[i] == ' ' || text[i]== '-') {
@@ -564,7 +690,7 @@ void ScreenDisplay::drawStringMaxWidth(int16_t xMove, int16_t yMove, uint16_t ma
     drawStringInternal(xMove, yMove + lineNumber * lineHeight , &text[lastDrawnPos], length - lastDrawnPos, getStringWidth(&text[lastDrawnPos], length - lastDrawnPos));
   }
 
-  free(text);
+  if (text != stackText) free(text);
 }
 
 uint16_t ScreenDisplay::getStringWidth(const char* text, uint16_t length) {
@@ -574,7 +700,9 @@ uint16_t ScreenDisplay::getStringWidth(const char* text, uint16_t length) {
   uint16_t maxWidth = 0;
 
   while (length--) {
-    stringWidth += pgm_read_byte(fontData + JUMPTABLE_START + (text[length] - firstChar) * JUMPTABLE_BYTES + JUMPTABLE_WIDTH);
+    if ((uint8_t) text[length] >= firstChar) {
+      stringWidth += getGlyph(text[length]).width;
+    }
     if (text[length] == 10) {
       maxWidth = max(maxWidth, stringWidth);
       stringWidth = 0;
@@ -585,10 +713,11 @@ uint16_t ScreenDisplay::getStringWidth(const char* text, uint16_t length) {
 }
 
 uint16_t ScreenDisplay::getStringWidth(String strUser) {
-  char* text = utf8ascii(strUser);
+  char stackText[DISPLAY_STACK_TEXT_SIZE];
+  char* text = utf8ascii(strUser.c_str(), stackText, sizeof(stackText));
   uint16_t length = strlen(text);
   uint16_t width = getStringWidth(text, length);
-  free(text);
+  if (text != stackText) free(text);
   return width;
 }
 
@@ -598,6 +727,29 @@ void ScreenDisplay::setTextAlignment(DISPLAY_TEXT_ALIGNMENT textAlignment) {
 
 void ScreenDisplay::setFont(const uint8_t *fontData) {
   this->fontData = fontData;
+  for (uint8_t i = 0; i < DISPLAY_GLYPH_CACHE_FONTS; i++) {
+    if (glyphCacheFonts[i] == fontData) {
+      this->glyphs = glyphCacheTables[i];
+      return;
+    }
+  }
+  // first use of this font. Decode its jump table, covering all 256 codes so lookups need no range check
+  this->glyphs = NULL;
+  uint8_t firstChar = pgm_read_byte(fontData + FIRST_CHAR_POS);
+  DisplayGlyph *table = (DisplayGlyph*) malloc((256 - firstChar) * sizeof(DisplayGlyph));
+  if (!table) {
+    DEBUG_DISPLAY("[DISPLAY][setFont] Not enough memory to cache the font\n");
+    return;
+  }
+  for (uint16_t code = firstChar; code < 256; code++) {
+    table[code - firstChar] = getGlyph(code);
+  }
+  uint8_t slot = glyphCacheNext;
+  glyphCacheNext = (glyphCacheNext + 1) % DISPLAY_GLYPH_CACHE_FONTS;
+  free(glyphCacheTables[slot]);
+  glyphCacheFonts[slot] = fontData;
+  glyphCacheTables[slot] = table;
+  this->glyphs = table;
 }
 
 void ScreenDisplay::displayOn(void) {
@@ -719,6 +871,7 @@ void ScreenDisplay::screenRotate(DISPLAY_ANGLE angle)
 			break;
 		}
 	}
+	markAllTilesDirty(); // buffer layout changed
 	sendScreenRotateCommand();
 }
 
@@ -733,6 +886,14 @@ void ScreenDisplay::flipScreenVertically() {
 
 void ScreenDisplay::clear(void) {
   memset(buffer, 0, displayBufferSize);
+#ifdef DISPLAY_DOUBLE_BUFFER
+  if (dirtyTiles) {
+    for (uint16_t i = 0; i < tileMapSize(); i++) {
+      dirtyTiles[i] |= inkedTiles[i];
+      inkedTiles[i] = 0;
+    }
+  }
+#endif
 }
 
 void ScreenDisplay::drawLogBuffer(uint16_t xMove, uint16_t yMove) {
@@ -929,6 +1090,7 @@ void inline ScreenDisplay::drawInternal(int16_t xMove, int16_t yMove, int16_t wi
     if (dataPos >=  0  && dataPos < displayBufferSize &&
         xPos    >=  0  && xPos    < this->width() ) {
 
+      markTile(dataPos);
       if (yOffset >= 0) {
         switch (this->color) {
           case WHITE:   buffer[dataPos] |= currentByte << yOffset; break;
@@ -937,6 +1099,7 @@ void inline ScreenDisplay::drawInternal(int16_t xMove, int16_t yMove, int16_t wi
         }
 
         if (dataPos < (displayBufferSize - this->width())) {
+          markTile(dataPos + this->width());
           switch (this->color) {
             case WHITE:   buffer[dataPos + this->width()] |= currentByte >> (8 - yOffset); break;
             case BLACK:   buffer[dataPos + this->width()] &= ~(currentByte >> (8 - yOffset)); break;
@@ -976,6 +1139,28 @@ void ScreenDisplay::wakeup() {
 }
 
 
+char* ScreenDisplay::utf8ascii(const char* str, char* stackBuffer, uint16_t stackBufferSize) {
+  uint16_t length = strlen(str);
+  char* s = stackBuffer;
+  if (length >= stackBufferSize) {
+    s = (char*) malloc(length + 1);
+    if (!s) {
+      DEBUG_DISPLAY("[DISPLAY][utf8ascii] Can't allocate another char array. Text is cut.\n");
+      s = stackBuffer;
+      length = stackBufferSize - 1;
+    }
+  }
+  uint16_t k = 0;
+  for (uint16_t i = 0; i < length; i++) {
+    char c = (this->fontTableLookupFunction)(str[i]);
+    if (c != 0) {
+      s[k++] = c;
+    }
+  }
+  s[k] = 0;
+  return s;
+}
+
 // You need to free the char!
 char* ScreenDisplay::utf8ascii(String str) {
   uint16_t k = 0;
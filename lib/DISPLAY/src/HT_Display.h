@@ -30,6 +30,18 @@
 #define FIRST_CHAR_POS 2
 #define CHAR_NUM_POS 3
 
+// Fonts with a decoded jump table in RAM. When more fonts are used the oldest table is replaced
+#define DISPLAY_GLYPH_CACHE_FONTS 4
+// Longer strings are copied to the heap for the utf8 conversion
+#define DISPLAY_STACK_TEXT_SIZE 64
+
+// Decoded jump table entry of one character
+struct DisplayGlyph {
+  uint16_t dataPos; // of the glyph data in the font. 0 if the character can't be drawn
+  uint8_t  size; // bytes of glyph data, trailing empty bytes are left out by the font
+  uint8_t  width;
+};
+
 
 // Display commands
 #define CHARGEPUMP 0x8D
@@ -184,11 +196,13 @@ class ScreenDisplay : public Print  {
 
     // Draws a string at the given location
     void drawString(int16_t x, int16_t y, String text);
+    void drawString(int16_t x, int16_t y, const char* text);
 
     // Draws a String with a maximum width at the given location.
     // If the given String is wider than the specified width
     // The text will be wrapped to the next line at a space or dash
     void drawStringMaxWidth(int16_t x, int16_t y, uint16_t maxLineWidth, String text);
+    void drawStringMaxWidth(int16_t x, int16_t y, uint16_t maxLineWidth, const char* text);
 
     // Returns the width of the const char* with the current
     // font settings
@@ -289,6 +303,32 @@ class ScreenDisplay : public Print  {
     DISPLAY_TYPE             displayType;
     const uint8_t	 *fontData;
 
+    #ifdef DISPLAY_DOUBLE_BUFFER
+    // One bit per tile of 8 buffer bytes (8 columns of one page), set by the drawing functions.
+    // display() only compares dirty tiles against buffer_back and clears the bits
+    uint8_t            *dirtyTiles;
+    // Tiles drawn to since the last clear(). Only these can be non zero, so clear() marks just them dirty
+    uint8_t            *inkedTiles;
+    #endif
+
+    uint16_t tileMapSize() const { return (displayBufferSize / 8 + 7) / 8; }
+
+    // pos is an index into buffer
+    inline void markTile(uint16_t pos) {
+    #ifdef DISPLAY_DOUBLE_BUFFER
+      if (!dirtyTiles) return;
+      uint16_t tile = pos >> 3;
+      dirtyTiles[tile >> 3] |= 1 << (tile & 7);
+      inkedTiles[tile >> 3] |= 1 << (tile & 7);
+    #endif
+    }
+
+    // from and to are indexes into buffer, to is included
+    void markTiles(uint16_t from, uint16_t to);
+
+    // buffer_back can't be trusted anymore (reset, rotation)
+    void markAllTilesDirty();
+
     // State values for logBuffer
     uint16_t   logBufferSize;
     uint16_t   logBufferFilled;
@@ -314,6 +354,21 @@ class ScreenDisplay : public Print  {
     // converts utf8 characters to extended ascii
     char* utf8ascii(String s);
 
+    // Converts str into stackBuffer if it fits, otherwise into a heap copy. Free the result if it is not stackBuffer
+    char* utf8ascii(const char* str, char* stackBuffer, uint16_t stackBufferSize);
+
+    // decoded jump table of fontData, NULL if it could not be allocated
+    DisplayGlyph *glyphs;
+    // recently used fonts and their decoded jump tables
+    const uint8_t *glyphCacheFonts[DISPLAY_GLYPH_CACHE_FONTS];
+    DisplayGlyph *glyphCacheTables[DISPLAY_GLYPH_CACHE_FONTS];
+    uint8_t glyphCacheNext;
+
+    DisplayGlyph getGlyph(uint8_t code);
+
+    // Draws font data of one character. Same output as drawInternal(), without the per byte divisions and bounds checks
+    void drawGlyph(int16_t xMove, int16_t yMove, const DisplayGlyph& glyph, int16_t textHeight, uint8_t rasterHeight);
+
     void inline drawInternal(int16_t xMove, int16_t yMove, int16_t width, int16_t height, const uint8_t *data, uint16_t offset, uint16_t bytesInData) __attribute__((always_inline));
 
     void drawStringInternal(int16_t xMove, int16_t yMove, char* text, uint16_t textLength, uint16_t textWidth);
@@ -4,6 +4,38 @@
 #include <HT_Display.h>
 #include <Wire.h>
 
+#define SSD1306_FLUSH_TASK_PRIORITY 1
+#define SSD1306_FLUSH_TASK_CORE 0 // the loop runs on core 1
+#define SSD1306_FLUSH_TASK_STACK 2048
+#define SSD1306_RECT_COMMAND_BYTES 18 // COLUMNADDR and PAGEADDR with arguments. Six transactions of three bytes
+#define SSD1306_MAX_RECTS 24 // more changes are sent as one bounding box
+
+/**
+ * Columns x0 to x1 of pages p0 to p1
+ */
+struct SSD1306Rect {
+  uint8_t x0;
+  uint8_t x1;
+  uint8_t p0;
+  uint8_t p1;
+
+  bool contains(uint8_t x, uint8_t page) const {
+    return x >= x0 && x <= x1 && page >= p0 && page <= p1;
+  }
+
+  SSD1306Rect merged(const SSD1306Rect& other) const {
+    return SSD1306Rect { _min(x0, other.x0), _max(x1, other.x1), _min(p0, other.p0), _max(p1, other.p1) };
+  }
+
+  /**
+   * Bytes on the bus: commands, data and the address + 0x40 header of every 16 data bytes
+   */
+  uint16_t cost() const {
+    uint16_t bytes = (x1 - x0 + 1) * (p1 - p0 + 1);
+    return SSD1306_RECT_COMMAND_BYTES + bytes + 2 * ((bytes + 15) / 16);
+  }
+};
+
 
 class SSD1306Wire : public ScreenDisplay {
   private:
@@ -12,6 +44,16 @@ class SSD1306Wire : public ScreenDisplay {
       int                 _scl;
       uint32_t             _freq;
       bool                _doI2cAutoInit = false;
+      // async flush, see beginAsyncFlush()
+      TaskHandle_t        flushTaskHandle = nullptr;
+      SemaphoreHandle_t   wireMutex = nullptr;
+      portMUX_TYPE        pendingFrameMux = portMUX_INITIALIZER_UNLOCKED;
+      uint8_t             *pendingFrame = nullptr; // latest frame from display()
+      uint8_t             *flushFrame = nullptr; // frame being sent
+      uint8_t             *pendingTiles = nullptr; // dirty tiles of all frames handed over since the last flush
+      uint8_t             *flushTiles = nullptr;
+      uint8_t             pendingColumns = 0;
+      uint8_t             pendingPages = 0;
 
   public:
     SSD1306Wire(uint8_t _address, uint32_t _freq, int sda,int scl, DISPLAY_GEOMETRY g = GEOMETRY_128_64,int8_t _rst=-1) {
@@ -30,241 +72,293 @@ class SSD1306Wire : public ScreenDisplay {
     }
 
 	void display(void) {
-		initI2cIfNeccesary();
-		if(rotate_angle==ANGLE_0_DEGREE||rotate_angle==ANGLE_180_DEGREE)
+		const uint8_t* frame = buffer;
+		uint8_t columns = this->width();
+		uint8_t pages = this->height() / 8;
+		uint8_t buffer_rotate[displayBufferSize];
+		if(rotate_angle!=ANGLE_0_DEGREE&&rotate_angle!=ANGLE_180_DEGREE)
 		{
-		#ifdef DISPLAY_DOUBLE_BUFFER
-			uint8_t minBoundY = UINT8_MAX;
-			uint8_t maxBoundY = 0;
-
-			uint8_t minBoundX = UINT8_MAX;
-			uint8_t maxBoundX = 0;
-			uint8_t x, y;
-
-			// Calculate the Y bounding box of changes
-			// and copy buffer[pos] to buffer_back[pos];
-			for (y = 0; y < (this->height() / 8); y++)
+			memset(buffer_rotate,0,displayBufferSize);
+			uint8_t temp;
+			for(uint16_t i=0;i<this->width();i++)
 			{
-				for (x = 0; x < this->width(); x++)
+				for(uint16_t j=0;j<this->height();j++)
 				{
-					uint16_t pos = x + y * this->width();
-					if (buffer[pos] != buffer_back[pos]) 
-					{
-						minBoundY = _min(minBoundY, y);
-						maxBoundY = _max(maxBoundY, y);
-						minBoundX = _min(minBoundX, x);
-						maxBoundX = _max(maxBoundX, x);
-					}
-					buffer_back[pos] = buffer[pos];
+					temp = buffer[(j>>3)*this->width()+i]>>(j&7)&0x01;
+					buffer_rotate[(i>>3)*this->height()+j]|=(temp<<(i&7));
 				}
-				//yield();
 			}
+			frame = buffer_rotate;
+			columns = this->height();
+			pages = this->width() / 8;
+		}
+	#ifdef DISPLAY_DOUBLE_BUFFER
+		const uint8_t* tiles = frame == buffer ? dirtyTiles : nullptr; // rotated frames are compared completely
+	#else
+		const uint8_t* tiles = nullptr;
+	#endif
+		if (flushTaskHandle)
+		{
+			// hand the frame to the flush task. A frame it has not picked up yet is replaced, its dirty tiles are kept
+			portENTER_CRITICAL(&pendingFrameMux);
+			memcpy(pendingFrame, frame, displayBufferSize);
+			pendingColumns = columns;
+			pendingPages = pages;
+			for (uint16_t i = 0; i < tileMapSize(); i++)
+			{
+				pendingTiles[i] |= tiles ? tiles[i] : 0xFF;
+			}
+			portEXIT_CRITICAL(&pendingFrameMux);
+			xTaskNotifyGive(flushTaskHandle);
+		}
+		else
+		{
+			flush(frame, columns, pages, tiles);
+		}
+	#ifdef DISPLAY_DOUBLE_BUFFER
+		if (dirtyTiles) memset(dirtyTiles, 0, tileMapSize());
+	#endif
+	}
 
-			// If the minBoundY wasn't updated
-			// we can savely assume that buffer_back[pos] == buffer[pos]
-			// holdes true for all values of pos
+	/**
+	 * Moves the I2C transfer of display() to a background task so the caller only pays for a copy of the frame.
+	 * Call after init(). Commands sent from other tasks are serialized with the transfer
+	 */
+	bool beginAsyncFlush(UBaseType_t priority = SSD1306_FLUSH_TASK_PRIORITY, BaseType_t core = SSD1306_FLUSH_TASK_CORE) {
+		if (flushTaskHandle) return true;
+		pendingFrame = (uint8_t*) malloc(displayBufferSize);
+		flushFrame = (uint8_t*) malloc(displayBufferSize);
+		pendingTiles = (uint8_t*) calloc(tileMapSize(), 1);
+		flushTiles = (uint8_t*) malloc(tileMapSize());
+		wireMutex = xSemaphoreCreateMutex();
+		if (!pendingFrame || !flushFrame || !pendingTiles || !flushTiles || !wireMutex)
+		{
+			endAsyncFlush();
+			return false;
+		}
+		if (xTaskCreatePinnedToCore(flushTask, "oledFlush", SSD1306_FLUSH_TASK_STACK, this, priority, &flushTaskHandle, core) != pdPASS)
+		{
+			flushTaskHandle = nullptr;
+			endAsyncFlush();
+			return false;
+		}
+		return true;
+	}
 
-			if (minBoundY == UINT8_MAX) return;
+	void endAsyncFlush() {
+		if (wireMutex) xSemaphoreTake(wireMutex, portMAX_DELAY); // not in the middle of a transfer
+		if (flushTaskHandle)
+		{
+			vTaskDelete(flushTaskHandle);
+			flushTaskHandle = nullptr;
+		}
+		if (wireMutex)
+		{
+			vSemaphoreDelete(wireMutex);
+			wireMutex = nullptr;
+		}
+		free(pendingFrame);
+		pendingFrame = nullptr;
+		free(flushFrame);
+		flushFrame = nullptr;
+		free(pendingTiles);
+		pendingTiles = nullptr;
+		free(flushTiles);
+		flushTiles = nullptr;
+	}
 
-			sendCommand(COLUMNADDR);
-#ifdef Wireless_Stick_V3
-      sendCommand( minBoundX+32);
-      sendCommand( maxBoundX+32);
-#else
-      sendCommand( minBoundX);
-      sendCommand( maxBoundX);
-#endif
-			sendCommand(PAGEADDR);
-			sendCommand(minBoundY);
-			sendCommand(maxBoundY);
+    void setI2cAutoInit(bool doI2cAutoInit) {
+      _doI2cAutoInit = doI2cAutoInit;
+    }
+
+	void stop(){
+		endAsyncFlush();
+		end();
+		Wire.end();
+	}
+  private:
+	int getBufferOffset(void) {
+		return 0;
+	}
+    inline void sendCommand(uint8_t command) __attribute__((always_inline)){
+      if (wireMutex) xSemaphoreTake(wireMutex, portMAX_DELAY);
+      writeCommand(command);
+      if (wireMutex) xSemaphoreGive(wireMutex);
+    }
+
+    void writeCommand(uint8_t command) {
+      initI2cIfNeccesary();
+      Wire.beginTransmission(_address);
+      Wire.write(0x80);
+      Wire.write(command);
+      Wire.endTransmission();
+    }
 
-			byte k = 0;
-			for (y = minBoundY; y <= maxBoundY; y++)
+	static void flushTask(void* parameter) {
+		SSD1306Wire* oled = (SSD1306Wire*) parameter;
+		while (true)
+		{
+			ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+			portENTER_CRITICAL(&oled->pendingFrameMux);
+			memcpy(oled->flushFrame, oled->pendingFrame, oled->displayBufferSize);
+			uint8_t columns = oled->pendingColumns;
+			uint8_t pages = oled->pendingPages;
+			memcpy(oled->flushTiles, oled->pendingTiles, oled->tileMapSize());
+			memset(oled->pendingTiles, 0, oled->tileMapSize());
+			portEXIT_CRITICAL(&oled->pendingFrameMux);
+			xSemaphoreTake(oled->wireMutex, portMAX_DELAY);
+			oled->flush(oled->flushFrame, columns, pages, oled->flushTiles);
+			xSemaphoreGive(oled->wireMutex);
+		}
+	}
+
+	/**
+	 * Sends frame to the panel. frame is laid out in pages of columns bytes.
+	 * With DISPLAY_DOUBLE_BUFFER the dirty tiles are compared against buffer_back and only the changed
+	 * ranges are sent, as several small rectangles. tiles == nullptr compares everything
+	 */
+	void flush(const uint8_t* frame, uint8_t columns, uint8_t pages, const uint8_t* tiles) {
+		initI2cIfNeccesary();
+	#ifdef DISPLAY_DOUBLE_BUFFER
+		SSD1306Rect rects[SSD1306_MAX_RECTS];
+		uint8_t rectCount = 0;
+		bool tooManyRects = false;
+		SSD1306Rect bounds = { UINT8_MAX, 0, UINT8_MAX, 0 };
+		uint8_t firstActive = 0; // rects before this index end above the previous page
+		for (uint8_t page = 0; page < pages; page++)
+		{
+			while (firstActive < rectCount && rects[firstActive].p1 + 1 < page) firstActive++;
+			for (uint8_t tileX = 0; tileX < columns / 8; tileX++)
 			{
-				for (x = minBoundX; x <= maxBoundX; x++)
+				uint16_t tile = page * (columns / 8) + tileX;
+				if (tiles && !(tiles[tile >> 3] & (1 << (tile & 7)))) continue;
+				for (uint8_t x = tileX * 8; x < tileX * 8 + 8; x++)
 				{
-					if (k == 0)
+					uint16_t pos = x + page * columns;
+					if (frame[pos] == buffer_back[pos]) continue;
+					buffer_back[pos] = frame[pos];
+					SSD1306Rect change = { x, x, page, page };
+					bounds = bounds.x0 == UINT8_MAX ? change : bounds.merged(change);
+					if (tooManyRects) continue;
+					// grow the rect where it costs the least, or start a new one if that is cheaper
+					int16_t bestSaving = -1;
+					uint8_t best = 0;
+					bool covered = false;
+					for (uint8_t i = firstActive; i < rectCount; i++)
 					{
-						Wire.beginTransmission(_address);
-						Wire.write(0x40);
+						if (rects[i].contains(x, page))
+						{
+							covered = true;
+							break;
+						}
+						int16_t saving = rects[i].cost() + change.cost() - rects[i].merged(change).cost();
+						if (saving > bestSaving)
+						{
+							bestSaving = saving;
+							best = i;
+						}
 					}
-
-					Wire.write(buffer[x + y * this->width()]);
-					k++;
-					if (k == 16)
+					if (covered) continue;
+					if (bestSaving >= 0)
 					{
-						Wire.endTransmission();
-						k = 0;
+						rects[best] = rects[best].merged(change);
+					}
+					else if (rectCount < SSD1306_MAX_RECTS)
+					{
+						rects[rectCount++] = change;
+					}
+					else
+					{
+						tooManyRects = true;
 					}
 				}
-				//yield();
 			}
+		}
+		if (bounds.x0 == UINT8_MAX) return; // nothing changed
+		uint16_t rectsCost = 0;
+		for (uint8_t i = 0; i < rectCount; i++)
+		{
+			rectsCost += rects[i].cost();
+		}
+		if (tooManyRects || rectsCost >= bounds.cost())
+		{
+			sendRect(frame, columns, bounds);
+			return;
+		}
+		for (uint8_t i = 0; i < rectCount; i++)
+		{
+			sendRect(frame, columns, rects[i]);
+		}
+	#else
+		writeCommand(COLUMNADDR);
+		writeCommand(0);
+		writeCommand(columns - 1);
 
-			if (k != 0) {
-				Wire.endTransmission();
-			}
-		#else
-
-			sendCommand(COLUMNADDR);
-			sendCommand(0);
-			sendCommand((this->width() - 1));
-
-			sendCommand(PAGEADDR);
-			sendCommand(0x0);
-
-			if (geometry == GEOMETRY_128_64)
-			{
-				sendCommand(0x7);
-			}
-			else if (geometry == GEOMETRY_128_32)
-			{
-				sendCommand(0x3);
-			}
+		writeCommand(PAGEADDR);
+		writeCommand(0x0);
 
-			for (uint16_t i=0; i < displayBufferSize; i++)
-			{
-				Wire.beginTransmission(this->_address);
-				Wire.write(0x40);
-				for (uint8_t x = 0; x < 16; x++)
-				{
-					Wire.write(buffer[i]);
-					i++;
-				}
-				i--;
-				Wire.endTransmission();
-			}
-		#endif
+		if (geometry == GEOMETRY_128_64)
+		{
+			writeCommand(0x7);
 		}
-		else
+		else if (geometry == GEOMETRY_128_32)
 		{
-			uint8_t buffer_rotate[displayBufferSize];
-			memset(buffer_rotate,0,displayBufferSize);
-			uint8_t temp;
-			for(uint16_t i=0;i<this->width();i++)
-			{
-				for(uint16_t j=0;j<this->height();j++)
-				{
-					temp = buffer[(j>>3)*this->width()+i]>>(j&7)&0x01;
-					buffer_rotate[(i>>3)*this->height()+j]|=(temp<<(i&7));
-				}
-			}
-		#ifdef DISPLAY_DOUBLE_BUFFER
-			uint8_t minBoundY = UINT8_MAX;
-			uint8_t maxBoundY = 0;
-			 
-			uint8_t minBoundX = UINT8_MAX;
-			uint8_t maxBoundX = 0;
-			uint8_t x, y;
-			 
-			// Calculate the Y bounding box of changes
-			// and copy buffer[pos] to buffer_back[pos];
-			for (y = 0; y < (this->width() / 8); y++)
+			writeCommand(0x3);
+		}
+
+		for (uint16_t i=0; i < displayBufferSize; i++)
+		{
+			Wire.beginTransmission(this->_address);
+			Wire.write(0x40);
+			for (uint8_t x = 0; x < 16; x++)
 			{
-				for (x = 0; x < this->height(); x++)
-				{
-					uint16_t pos = x + y * this->height();
-					if (buffer_rotate[pos] != buffer_back[pos])
-					{
-						minBoundY = _min(minBoundY, y);
-						maxBoundY = _max(maxBoundY, y);
-						minBoundX = _min(minBoundX, x);
-						maxBoundX = _max(maxBoundX, x);
-					}
-					buffer_back[pos] = buffer_rotate[pos];
-				}
-				//yield();
+				Wire.write(frame[i]);
+				i++;
 			}
-			if (minBoundY == UINT8_MAX) return;
+			i--;
+			Wire.endTransmission();
+		}
+	#endif
+	}
 
-			sendCommand(COLUMNADDR);
+	void sendRect(const uint8_t* frame, uint8_t columns, const SSD1306Rect& rect) {
+		writeCommand(COLUMNADDR);
 #ifdef Wireless_Stick_V3
-      sendCommand( minBoundX+32);
-      sendCommand( maxBoundX+32);
+		writeCommand( rect.x0+32);
+		writeCommand( rect.x1+32);
 #else
-      sendCommand( minBoundX);
-      sendCommand( maxBoundX);
+		writeCommand( rect.x0);
+		writeCommand( rect.x1);
 #endif
-			sendCommand(PAGEADDR);
-			sendCommand(minBoundY);
-			sendCommand(maxBoundY);
+		writeCommand(PAGEADDR);
+		writeCommand(rect.p0);
+		writeCommand(rect.p1);
 
-			byte k = 0;
-			for (y = minBoundY; y <= maxBoundY; y++)
+		byte k = 0;
+		for (uint8_t y = rect.p0; y <= rect.p1; y++)
+		{
+			for (uint8_t x = rect.x0; x <= rect.x1; x++)
 			{
-				for (x = minBoundX; x <= maxBoundX; x++)
+				if (k == 0)
 				{
-					if (k == 0)
-					{
-						Wire.beginTransmission(_address);
-						Wire.write(0x40);
-					}
-
-					Wire.write(buffer_rotate[x + y * this->height()]);
-					k++;
-					if (k == 16)
-					{
-						Wire.endTransmission();
-						k = 0;
-					}
+					Wire.beginTransmission(_address);
+					Wire.write(0x40);
 				}
-				//yield();
-			}
-
-			if (k != 0) {
-				Wire.endTransmission();
-			}
-		#else
-			sendCommand(COLUMNADDR);
-			sendCommand(0);
-			sendCommand((this->height() - 1));
 
-			sendCommand(PAGEADDR);
-			sendCommand(0x0);
-
-			if (geometry == GEOMETRY_128_64)
-			{
-				sendCommand(0x7);
-			}
-			else if (geometry == GEOMETRY_128_32)
-			{
-				sendCommand(0x3);
-			}
-
-			for (uint16_t i=0; i < displayBufferSize; i++)
-			{
-				Wire.beginTransmission(this->_address);
-				Wire.write(0x40);
-				for (uint8_t x = 0; x < 16; x++)
+				Wire.write(frame[x + y * columns]);
+				k++;
+				if (k == 16)
 				{
-					Wire.write(buffer_rotate[i]);
-					i++;
+					Wire.endTransmission();
+					k = 0;
 				}
-				i--;
-				Wire.endTransmission();
 			}
-		#endif
 		}
-	}
-
-    void setI2cAutoInit(bool doI2cAutoInit) {
-      _doI2cAutoInit = doI2cAutoInit;
-    }
 
-	void stop(){
-		end();
-		Wire.end();
-	}
-  private:
-	int getBufferOffset(void) {
-		return 0;
+		if (k != 0) {
+			Wire.endTransmission();
+		}
 	}
-    inline void sendCommand(uint8_t command) __attribute__((always_inline)){
-      initI2cIfNeccesary();
-      Wire.beginTransmission(_address);
-      Wire.write(0x80);
-      Wire.write(command);
-      Wire.endTransmission();
-    }
 
     void initI2cIfNeccesary() {
       if (_doI2cAutoInit) {
@@ -1,6 +1,13 @@
 #pragma once
 #include <Arduino.h>
 
+/**
+ * Minimal JSON writer. Output goes to one of
+ *  - an internal String (default constructor)
+ *  - a caller provided buffer. Output is truncated and overflowed() is set when it does not fit
+ *  - a Print sink (Stream, File, ...)
+ * Numbers are formatted in place and strings escaped in a single pass, so writing into a buffer or sink never allocates
+ */
 class JsonBuilder {
 public:
     JsonBuilder() {
@@ -8,25 +15,43 @@ public:
     }
 
     /**
-     * @brief 
-     * 
+     * @param buffer is always kept null terminated
+     */
+    JsonBuilder(char* buffer, size_t capacity) : buffer(buffer), capacity(capacity) {
+        if(capacity > 0) {
+            buffer[0] = 0;
+        }
+    }
+
+    JsonBuilder(Print& sink) : sink(&sink) {}
+
+    /**
+     * @brief
+     *
      * @param trigger The trigger to be inserted into JSON
      * @param lapIndex the index of the Trigger
      */
     void insertTriggerObj(Trigger trigger) {
         startObject();
         addKey("type"); // triggerType
-        addValue(trigger.triggerType);
+        addValue(int(trigger.triggerType));
         addKey("ms"); // milliseconds
-        addValue(trigger.timeMs);
+        addValue(int(trigger.timeMs));
         addKey("mm"); // millimeters
-        addValue(trigger.millimeters);
+        addValue(int(trigger.millimeters));
         endObject();
     }
 
+    /**
+     * Newlines and indentation. Off by default
+     */
+    void setPretty(bool pretty) {
+        this->pretty = pretty;
+    }
+
     void startObject() {
         addSeparatorIfNeeded();
-        json += "{";
+        write('{');
         indentationLevel++;
         needsSeparator = false;
     }
@@ -34,13 +59,13 @@ public:
     void endObject() {
         indentationLevel--;
         newlineAndIndent();
-        json += "}";
+        write('}');
         needsSeparator = true;
     }
 
     void startArray() {
         addSeparatorIfNeeded();
-        json += "[";
+        write('[');
         indentationLevel++;
         needsSeparator = false;
     }
@@ -48,74 +73,227 @@ public:
     void endArray() {
         indentationLevel--;
         newlineAndIndent();
-        json += "]";
+        write(']');
         needsSeparator = true;
     }
 
+    void addKey(const char* key) {
+        addSeparatorIfNeeded();
+        writeString(key, strlen(key));
+        write(':');
+        needsSeparator = false;
+    }
+
     void addKey(const String& key) {
         addSeparatorIfNeeded();
-        json += "\"" + key + "\":";
+        writeString(key.c_str(), key.length());
+        write(':');
         needsSeparator = false;
     }
 
     void addValue(bool value) {
         addSeparatorIfNeeded();
-        json += (value ? "true" : "false");
+        if(value) {
+            write("true", 4);
+        } else {
+            write("false", 5);
+        }
         needsSeparator = true;
     }
 
     void addValue(int value) {
         addSeparatorIfNeeded();
-        json += String(value);
+        writeInt(value);
         needsSeparator = true;
     }
 
+    /**
+     * Two decimals like String(float)
+     */
     void addValue(float value) {
         addSeparatorIfNeeded();
-        json += String(value);
+        if(isnan(value) || isinf(value)) {
+            write("null", 4);
+        } else {
+            int64_t hundredths = llroundf(value * 100);
+            if(hundredths < 0) {
+                write('-');
+                hundredths = -hundredths;
+            }
+            writeUnsigned(uint64_t(hundredths / 100));
+            char decimals[3] = { '.', char('0' + hundredths % 100 / 10), char('0' + hundredths % 10) };
+            write(decimals, 3);
+        }
+        needsSeparator = true;
+    }
+
+    void addValue(const char* value) {
+        addSeparatorIfNeeded();
+        writeString(value, strlen(value));
         needsSeparator = true;
     }
 
     void addValue(const String& value) {
         addSeparatorIfNeeded();
-        json += "\"" + escapeString(value) + "\"";
+        writeString(value.c_str(), value.length());
         needsSeparator = true;
     }
 
+    /**
+     * Copy of the output. Empty when writing to a sink
+     */
     String getJson() const {
+        if(buffer) {
+            return String(buffer);
+        }
         return json;
     }
 
+    const char* c_str() const {
+        if(buffer) {
+            return buffer;
+        }
+        return json.c_str();
+    }
+
+    /**
+     * Bytes generated. For a sink the bytes written since the last clearJson()
+     */
+    size_t length() const {
+        if(buffer || sink) {
+            return used;
+        }
+        return json.length();
+    }
+
+    /**
+     * Drops the generated text but keeps the nesting state, so the next piece continues the same document.
+     * Used for streaming responses piece by piece. The internal String keeps its capacity
+     */
+    void clearJson() {
+        used = 0;
+        overflow = false;
+        if(buffer && capacity > 0) {
+            buffer[0] = 0;
+        }
+        json = "";
+    }
+
+    /**
+     * Preallocates the internal String
+     */
+    void reserve(size_t size) {
+        json.reserve(size);
+    }
+
+    /**
+     * True if output did not fit into the buffer
+     */
+    bool overflowed() const {
+        return overflow;
+    }
+
 private:
     String json;
+    char* buffer = nullptr;
+    size_t capacity = 0;
+    Print* sink = nullptr;
+    size_t used = 0; // buffer and sink only
+    bool overflow = false;
+    bool pretty = false;
     int indentationLevel = 0;
     bool needsSeparator = false;
 
+    void write(const char* data, size_t len) {
+        if(sink) {
+            used += sink->write((const uint8_t*) data, len);
+        } else if(buffer) {
+            if(used + len >= capacity) {
+                overflow = true;
+                len = capacity > used + 1 ? capacity - used - 1 : 0;
+            }
+            memcpy(buffer + used, data, len);
+            used += len;
+            if(capacity > 0) {
+                buffer[used] = 0;
+            }
+        } else {
+            json.concat(data, len);
+        }
+    }
+
+    void write(char c) {
+        write(&c, 1);
+    }
+
+    void writeUnsigned(uint64_t value) {
+        char digits[20];
+        size_t start = sizeof(digits);
+        do {
+            digits[--start] = '0' + value % 10;
+            value /= 10;
+        } while(value > 0);
+        write(digits + start, sizeof(digits) - start);
+    }
+
+    void writeInt(int64_t value) {
+        if(value < 0) {
+            write('-');
+            writeUnsigned(uint64_t(0) - uint64_t(value));
+        } else {
+            writeUnsigned(uint64_t(value));
+        }
+    }
+
+    /**
+     * Quoted and escaped. Unescaped runs are written in one piece
+     */
+    void writeString(const char* input, size_t len) {
+        static const char hex[] = "0123456789abcdef";
+        write('"');
+        size_t runStart = 0;
+        for (size_t i = 0; i < len; i++) {
+            const unsigned char c = input[i];
+            char escaped[6] = { '\\', 0, 0, 0, 0, 0 };
+            size_t escapedLength = 2;
+            switch(c) {
+                case '"': escaped[1] = '"'; break;
+                case '\\': escaped[1] = '\\'; break;
+                case '/': escaped[1] = '/'; break;
+                case '\b': escaped[1] = 'b'; break;
+                case '\f': escaped[1] = 'f'; break;
+                case '\n': escaped[1] = 'n'; break;
+                case '\r': escaped[1] = 'r'; break;
+                case '\t': escaped[1] = 't'; break;
+                default:
+                    if(c >= 0x20) continue;
+                    escaped[1] = 'u';
+                    escaped[2] = '0';
+                    escaped[3] = '0';
+                    escaped[4] = hex[c >> 4];
+                    escaped[5] = hex[c & 0xF];
+                    escapedLength = 6;
+            }
+            write(input + runStart, i - runStart);
+            write(escaped, escapedLength);
+            runStart = i + 1;
+        }
+        write(input + runStart, len - runStart);
+        write('"');
+    }
+
     void addSeparatorIfNeeded() {
         if (needsSeparator) {
-            json += ",";
+            write(',');
             newlineAndIndent();
         }
     }
 
     void newlineAndIndent() {
-        json += "\n";
+        if(!pretty) return;
+        write('\n');
         for (int i = 0; i < indentationLevel; i++) {
-            json += "    ";
+            write("    ", 4);
         }
     }
-
-    String escapeString(const String& input) {
-        String output = input;
-        output.replace("\"", "\\\"");
-        output.replace("\\", "\\\\");
-        output.replace("/", "\\/");
-        output.replace("\b", "\\b");
-        output.replace("\f", "\\f");
-        output.replace("\n", "\\n");
-        output.replace("\r", "\\r");
-        output.replace("\t", "\\t");
-        // Add other escape sequences if needed
-        return output;
-    }
-};
\ No newline at end of file
+};
@@ -3,6 +3,44 @@
 #include <FastLED.h>
 #include "fonts.h"
 
+#define FONT_SMALL_GLYPHS (sizeof(fontSmall) / sizeof(fontSmall[0]))
+#define FONT_NORMAL_GLYPHS (sizeof(fontNormal) / sizeof(fontNormal[0]))
+
+/**
+ * Width of a glyph without its empty columns
+ */
+constexpr uint8_t trimmedWidth(const uint8_t* letter, uint8_t width) {
+    return width > 0 && !letter[width - 1] ? trimmedWidth(letter, width - 1) : width;
+}
+
+template<typename Indices> struct GlyphWidths;
+template<size_t... I> struct GlyphWidths<LedIndexList<I...>> {
+    static constexpr uint8_t small[sizeof...(I)] = { uint8_t(I < FONT_SMALL_GLYPHS ? trimmedWidth(fontSmall[I], FONT_SMALL_WIDTH) : 0)... };
+    static constexpr uint8_t normal[sizeof...(I)] = { uint8_t(I < FONT_NORMAL_GLYPHS ? trimmedWidth(fontNormal[I], FONT_NORMAL_WIDTH) : 0)... };
+};
+template<size_t... I> constexpr uint8_t GlyphWidths<LedIndexList<I...>>::small[sizeof...(I)];
+template<size_t... I> constexpr uint8_t GlyphWidths<LedIndexList<I...>>::normal[sizeof...(I)];
+
+typedef GlyphWidths<MakeLedIndexList<(FONT_SMALL_GLYPHS > FONT_NORMAL_GLYPHS ? FONT_SMALL_GLYPHS : FONT_NORMAL_GLYPHS)>::type> glyphWidths;
+
+/**
+ * Font columns and proportional width of digit
+ * @return false if the font has no glyph for digit
+ */
+static bool findGlyph(char digit, uint8_t settings, const uint8_t*& letter, uint8_t& trimmed) {
+    uint8_t index = digit - ASCII_OFFSET;
+    if(settings & FONT_SIZE_SMALL) {
+        if(index >= FONT_SMALL_GLYPHS) return false;
+        letter = fontSmall[index];
+        trimmed = glyphWidths::small[index];
+    } else {
+        if(index >= FONT_NORMAL_GLYPHS) return false;
+        letter = fontNormal[index];
+        trimmed = glyphWidths::normal[index];
+    }
+    return true;
+}
+
 void swap(int& a, int& b) {
     int tmp = b;
     b = a;
@@ -13,6 +51,7 @@ LedMatrix::LedMatrix() {
     this->leds = 0;
     this->numLeds = 0;
     this->pixelConverter = 0;
+    this->pixelMap = 0;
     this->width = 0;
     this->height = 0;
     this->blur = 0;
@@ -22,6 +61,17 @@ LedMatrix::LedMatrix(CRGB* leds, size_t numLeds, PixelConverter pixelConverter,
     this->leds = leds;
     this->numLeds = numLeds;
     this->pixelConverter = pixelConverter;
+    this->pixelMap = 0;
+    this->width = width;
+    this->height = height;
+    this->blur = 0;
+}
+
+LedMatrix::LedMatrix(CRGB* leds, size_t numLeds, const uint16_t* pixelMap, size_t width, size_t height) {
+    this->leds = leds;
+    this->numLeds = numLeds;
+    this->pixelConverter = 0;
+    this->pixelMap = pixelMap;
     this->width = width;
     this->height = height;
     this->blur = 0;
@@ -29,13 +79,17 @@ LedMatrix::LedMatrix(CRGB* leds, size_t numLeds, PixelConverter pixelConverter,
 
 void LedMatrix::setPixel(int x, int y, CRGB color, bool additive) {
     if(x < 0 || x >= width || y < 0 || y >= height) return;
-    uint16_t index = pixelConverter(x, y);
+    uint16_t index = pixelIndex(x, y);
     if(index < numLeds) {
         leds[index] = leds[index] + color * additive;
     }
 }
 
 void LedMatrix::renderPixel(int x, int y, CRGB color) {
+    if(blur == 0) { // no halo, skip the floating point math
+        setPixel(x, y, color, true);
+        return;
+    }
     int blurry = 1.0 + blur * 4.0;
     color *= 1 - blur * 0.5;
     setPixel(x, y, color, blur == 0);
@@ -89,15 +143,11 @@ int LedMatrix::print(char digit, int xPos, int yPos, CRGB color, uint8_t setting
     if((settings & UPPERCASE) && digit >= 'a' && digit <= 'z') {
         digit -= 32;
     }
-    uint8_t index = digit - ASCII_OFFSET;
     uint8_t width, height;
-    const uint8_t* letter;
     if((settings & FONT_SIZE_SMALL) > 0) {
-        letter = fontSmall[index];
         width = FONT_SMALL_WIDTH;
         height = FONT_SMALL_HEIGHT;
     } else {
-        letter = fontNormal[index];
         width = FONT_NORMAL_WIDTH;
         height = FONT_NORMAL_HEIGHT;
     }
@@ -109,15 +159,15 @@ int LedMatrix::print(char digit, int xPos, int yPos, CRGB color, uint8_t setting
         return xPos + (width / 2);
     }
 
-    if(!(settings & MONOSPACE)) while(!letter[width - 1]) width--;
+    const uint8_t* letter;
+    uint8_t trimmed;
+    if(!findGlyph(digit, settings, letter, trimmed)) {
+        return xPos;
+    }
+    if(!(settings & MONOSPACE)) width = trimmed;
 
     for (int x = xStart; x < min(width, maxWidth); x++) {
-        uint8_t column = letter[width - x - 1];
-        for (int y = 0; y < height; y++) {
-            if(column & (0b00000001 << (height - y - 1))) {
-                renderPixel(x + xPos, y + yPos, color);
-            }
-        }
+        renderColumn(x + xPos, yPos, letter[width - x - 1], height, color);
     }
     if(settings & UNDERLINE) {
         for (int x = xStart; x < min(width + (settings & SPACING), (int) maxWidth); x++) {
@@ -130,6 +180,29 @@ int LedMatrix::print(char digit, int xPos, int yPos, CRGB color, uint8_t setting
     return xPos + width + (settings & SPACING);
 }
 
+/**
+ * One font column, bit height - 1 is the top pixel. Written straight into leds unless blur is set
+ */
+void LedMatrix::renderColumn(int x, int y, uint8_t column, uint8_t height, CRGB color) {
+    if(blur != 0) {
+        for (int row = 0; row < height; row++) {
+            if(column & (0b00000001 << (height - row - 1))) {
+                renderPixel(x, y + row, color);
+            }
+        }
+        return;
+    }
+    if(!column || x < 0 || x >= int(width)) return;
+    for (int row = 0; row < height; row++) {
+        if(!(column & (0b00000001 << (height - row - 1)))) continue;
+        if(y + row < 0 || y + row >= int(this->height)) continue;
+        uint16_t index = pixelIndex(x, y + row);
+        if(index < numLeds) {
+            leds[index] += color;
+        }
+    }
+}
+
 void LedMatrix::line(double x1, double y1, double x2, double y2, CRGB color) {
     line((int) round(x1), (int) round(y1), (int) round(x2), (int) round(y2), color);
 }
@@ -180,23 +253,19 @@ int LedMatrix::boundsFromChar(char digit, uint8_t settings) {
     if((settings & UPPERCASE) && digit >= 'a' && digit <= 'z') {
         digit -= 32;
     }
-    uint8_t index = digit - ASCII_OFFSET;
-    uint8_t width;
-    const uint8_t* letter;
-    if(settings & FONT_SIZE_SMALL) {
-        letter = fontSmall[index];
-        width = FONT_SMALL_WIDTH;
-    } else {
-        letter = fontNormal[index];
-        width = FONT_NORMAL_WIDTH;
-    }
+    uint8_t width = (settings & FONT_SIZE_SMALL) ? FONT_SMALL_WIDTH : FONT_NORMAL_WIDTH;
     if(digit == '\t') {
         return 2 * width; // tab
     }
     if(digit == ' ') {
         return width / 2;
     }
-    if(!(settings & MONOSPACE)) while(!letter[width - 1]) width--;
+    const uint8_t* letter;
+    uint8_t trimmed;
+    if(!findGlyph(digit, settings, letter, trimmed)) {
+        return 0;
+    }
+    if(!(settings & MONOSPACE)) width = trimmed;
     // if(digit == '.' || digit == ',') {
     //     width--;
     // }
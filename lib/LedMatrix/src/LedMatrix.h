@@ -19,10 +19,33 @@
 
 typedef uint16_t (*PixelConverter)(uint16_t x, uint16_t y);
 
+/**
+ * Compile time list 0, 1, ..., N - 1 (std::index_sequence needs C++14)
+ */
+template<size_t... I> struct LedIndexList {};
+template<size_t N, size_t... I> struct MakeLedIndexList : MakeLedIndexList<N - 1, N - 1, I...> {};
+template<size_t... I> struct MakeLedIndexList<0, I...> { typedef LedIndexList<I...> type; };
+
+template<PixelConverter convert, size_t width, typename Indices> struct LedPixelMapTable;
+template<PixelConverter convert, size_t width, size_t... I> struct LedPixelMapTable<convert, width, LedIndexList<I...>> {
+    static constexpr uint16_t pixels[sizeof...(I)] = { convert(I % width, I / width)... };
+};
+template<PixelConverter convert, size_t width, size_t... I> constexpr uint16_t LedPixelMapTable<convert, width, LedIndexList<I...>>::pixels[sizeof...(I)];
+
+/**
+ * Led index of every pixel at pixels[x + y * width], generated at compile time. convert has to be constexpr
+ */
+template<PixelConverter convert, size_t width, size_t height>
+struct LedPixelMap : LedPixelMapTable<convert, width, typename MakeLedIndexList<width * height>::type> {};
+
 class LedMatrix {
 public:
     LedMatrix();
     LedMatrix(CRGB* leds, size_t numLeds, PixelConverter pixelConverter, size_t width = 32, size_t height = 8);
+    /**
+     * @param pixelMap width * height led indices, see LedPixelMap
+     */
+    LedMatrix(CRGB* leds, size_t numLeds, const uint16_t* pixelMap, size_t width = 32, size_t height = 8);
 
     void setPixel(int x, int y, CRGB color, bool additive = false);
     void renderPixel(int x, int y, CRGB color);
@@ -64,6 +87,12 @@ private:
     size_t numLeds;
 
     PixelConverter pixelConverter;
+    const uint16_t* pixelMap;
+
+    uint16_t pixelIndex(int x, int y) {
+        return pixelMap ? pixelMap[x + y * width] : pixelConverter(x, y);
+    }
+    void renderColumn(int x, int y, uint8_t column, uint8_t height, CRGB color);
 
     size_t width;
     size_t height;
@@ -1,5 +1,11 @@
 #include <gui.h>
 
+static bool uiDirty = true;
+
+void invalidateUI() {
+    uiDirty = true;
+}
+
 void frameDelegator(ScreenDisplay *display, DisplayUiState* state, int16_t x, int16_t y) {
     if(state->currentRendering >= UIManager::frameSectionsCount) return;
     UIManager::frameSections[state->currentRendering].render(display, state, x, y);
@@ -23,6 +29,12 @@ Menu::Menu(const char* backBtnText) {
 void Menu::render(ScreenDisplay *display, DisplayUiState* state, int16_t x, int16_t y) {
     this->x = this->targetX * lpf + (1.0 - lpf) * this->x;
     this->y = this->targetY * lpf + (1.0 - lpf) * this->y;
+    if(fabs(this->targetX - this->x) < 0.5 && fabs(this->targetY - this->y) < 0.5) { // settled
+        this->x = this->targetX;
+        this->y = this->targetY;
+    } else {
+        invalidateUI(); // keep animating
+    }
     x -= int(this->x);
     y -= int(this->y);
     if(activeItem >= menuItemsCount) {
@@ -230,9 +242,7 @@ void UIManager::begin(OverlayCallback* userOverlays, size_t overlayCount, FrameS
         }
     }
 
-    // The ESP is capable of rendering 60fps in 80Mhz mode
-    // but that won't give you much time for anything else
-    // run it in 160Mhz mode or just set it to 30 fps
+    // Upper limit. Frames are only rendered after invalidateUI() and during transitions and animations
     displayUI->setTargetFPS(60);
 
     // Customize the active and inactive symbol
@@ -274,6 +284,7 @@ void UIManager::begin(OverlayCallback* userOverlays, size_t overlayCount, FrameS
     }
 
     displayUI->disableAutoTransition();
+    invalidateUI();
 }
 
 void UIManager::handle(bool forceUpdate) {
@@ -284,8 +295,15 @@ void UIManager::handle(bool forceUpdate) {
         mouseDownMs = INT64_MAX;
         // mouseDown = false;
     }
+    if(!uiDirty && !forceUpdate && displayUI->getUiState()->frameState != IN_TRANSITION) return; // nothing changed
     if(millis() > nextUIUpdate || forceUpdate) {
+        DisplayUiState* state = displayUI->getUiState();
+        uint64_t lastFrame = state->lastUpdate;
+        uiDirty = false; // rendering may invalidate again to continue an animation
         nextUIUpdate = millis() + displayUI->update();
+        if(state->lastUpdate == lastFrame) { // update() skipped the frame
+            uiDirty = true;
+        }
     }
 }
 
@@ -295,6 +313,7 @@ void UIManager::triggerInputEvent(GUIInputEvent event) {
 
 void UIManager::popup(const char* message) {
     this->message = message;
+    invalidateUI();
 }
 
 GUIProcessedEvent UIManager::processEvent(GUIInputEvent event) {
@@ -335,6 +354,7 @@ GUIProcessedEvent UIManager::processEvent(GUIInputEvent event) {
 
 void UIManager::handleProcessedEvent(GUIProcessedEvent event) {
     if(event == PROCESSED_EVENT_NONE) return;
+    invalidateUI();
     if(message != nullptr) {
         message = nullptr;
         return;
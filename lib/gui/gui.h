@@ -14,8 +14,19 @@ typedef int64_t timeUs_t;
 
 #define MAX_SELECT_OPTIONS 6
 
+#define LIST_VIEW_ROWS 4 // visible at once
+#define LIST_VIEW_ROW_HEIGHT 12
+#define LIST_VIEW_WINDOW_ROWS 12 // rows requested at once. Scrolling within them does not call the rows callback
+#define LIST_VIEW_LABEL_SIZE 12
+#define LIST_VIEW_VALUE_SIZE 16
+
 typedef void (*ChangeListener)();
 
+/**
+ * Marks the screen as outdated. UIManager::handle() only renders after an invalidation or while something is animating
+ */
+void invalidateUI();
+
 enum GUIInputEvent {
     INPUT_EVENT_SCROLL_UP = 0,
     INPUT_EVENT_SCROLL_DOWN,
@@ -95,11 +106,15 @@ public:
     }
 
     void setHighlighted(bool highlighted) {
+        if(this->highlighted == highlighted) return;
         this->highlighted = highlighted;
+        invalidateUI();
     }
 
     void setHidden(bool hidden) {
+        if(this->hiding == hidden) return;
         this->hiding = hidden;
+        invalidateUI();
     }
 
     bool isHidden() {
@@ -141,8 +156,12 @@ public:
         this->textAlignment = textAlignment;
     }
 
+    /**
+     * Also call this after changing the contents of the current text buffer
+     */
     void setText(const char* text) {
         this->text = text;
+        invalidateUI();
     }
 
     void renderComponent(ScreenDisplay *display, DisplayUiState* state, int16_t x, int16_t y) override {
@@ -288,6 +307,9 @@ public:
     void setChecked(bool checked, bool silent = true) {
         bool checkedBefore = this->checked;
         this->checked = checked;
+        if(checkedBefore != checked) {
+            invalidateUI();
+        }
         if(!silent && checkedBefore != checked) {
             change();
         }
@@ -391,7 +413,9 @@ public:
     void setValue(double value) {
         if(value < this->min) value = this->min;
         if(value > this->max) value = this->max;
+        if(this->number == value) return;
         this->number = value;
+        invalidateUI();
     }
 
     void removeFocus() {
@@ -446,6 +470,122 @@ public:
     }
 };
 
+struct ListRow {
+    char label[LIST_VIEW_LABEL_SIZE];
+    char value[LIST_VIEW_VALUE_SIZE];
+    bool separator; // line above the row
+};
+
+typedef size_t (*ListRowCountCallback)();
+
+/**
+ * Writes up to count rows starting at first into rows. Returns how many were written
+ */
+typedef size_t (*ListRowsCallback)(size_t first, size_t count, ListRow* rows);
+
+/**
+ * Scrollable list of label/value rows. Rows are never stored as items. Only a window around the visible rows is requested from the
+ * callbacks, so the list can be arbitrarily long
+ */
+class ListView : public MenuItem {
+public:
+    ListView(ListRowCountCallback rowCount, ListRowsCallback getRows, const char* emptyText = "Empty") : MenuItem(true, LIST_VIEW_ROWS * LIST_VIEW_ROW_HEIGHT) {
+        this->rowCount = rowCount;
+        this->getRows = getRows;
+        this->emptyText = emptyText;
+        this->first = 0;
+        this->windowFirst = 0;
+        this->windowCount = 0;
+        this->windowValid = false;
+    }
+
+    /**
+     * Call after the rows changed. A scrolled list moves down by rowsAddedOnTop to keep showing the same rows
+     */
+    void refresh(size_t rowsAddedOnTop = 0) {
+        if(first > 0) {
+            first += rowsAddedOnTop;
+        }
+        windowValid = false;
+        invalidateUI();
+    }
+
+    void renderComponent(ScreenDisplay *display, DisplayUiState* state, int16_t x, int16_t y) override {
+        const size_t count = rowCount();
+        if(first + LIST_VIEW_ROWS > count) {
+            first = count > LIST_VIEW_ROWS ? count - LIST_VIEW_ROWS : 0;
+        }
+        const size_t visible = min(size_t(LIST_VIEW_ROWS), count - first);
+        if(!windowValid || first < windowFirst || first + visible > windowFirst + windowCount) {
+            // request the visible rows in the middle of the window so scrolling either way stays in it for a while
+            windowFirst = first > (LIST_VIEW_WINDOW_ROWS - LIST_VIEW_ROWS) / 2 ? first - (LIST_VIEW_WINDOW_ROWS - LIST_VIEW_ROWS) / 2 : 0;
+            windowCount = getRows(windowFirst, min(size_t(LIST_VIEW_WINDOW_ROWS), count - min(count, windowFirst)), window);
+            windowValid = true;
+        }
+        display->setFont(ArialMT_Plain_10);
+        if(count == 0) {
+            display->setTextAlignment(TEXT_ALIGN_CENTER);
+            display->drawString(x + 64, y, emptyText);
+            return;
+        }
+        for (size_t i = 0; i < visible && first + i < windowFirst + windowCount; i++) {
+            const ListRow& row = window[first + i - windowFirst];
+            const int16_t rowY = y + i * LIST_VIEW_ROW_HEIGHT;
+            if(row.separator && i > 0) {
+                display->drawHorizontalLine(x + 24, rowY, 98);
+            }
+            display->setTextAlignment(TEXT_ALIGN_LEFT);
+            display->drawString(x + 26, rowY, row.label);
+            display->setTextAlignment(TEXT_ALIGN_RIGHT);
+            display->drawString(x + 122, rowY, row.value);
+        }
+        if(count > LIST_VIEW_ROWS) { // scroll bar
+            const int16_t trackHeight = LIST_VIEW_ROWS * LIST_VIEW_ROW_HEIGHT;
+            const int16_t thumbHeight = max(4, int(trackHeight * LIST_VIEW_ROWS / count));
+            const int16_t thumbY = (trackHeight - thumbHeight) * first / (count - LIST_VIEW_ROWS);
+            display->drawVerticalLine(x + 126, y + thumbY, thumbHeight);
+            display->drawVerticalLine(x + 127, y + thumbY, thumbHeight);
+        }
+    }
+
+    bool handleEvent(GUIProcessedEvent event) {
+        switch(event) {
+            case PROCESSED_EVENT_SCROLL_DOWN:
+                if(first + LIST_VIEW_ROWS < rowCount()) {
+                    first++;
+                    invalidateUI();
+                }
+                return false;
+            case PROCESSED_EVENT_SCROLL_UP:
+                if(first > 0) {
+                    first--;
+                    invalidateUI();
+                }
+                return false;
+            default:
+                return true;
+        }
+    }
+
+    bool focus() override {
+        return rowCount() <= LIST_VIEW_ROWS; // nothing to scroll
+    }
+
+    void removeFocus() {
+
+    }
+
+private:
+    ListRowCountCallback rowCount;
+    ListRowsCallback getRows;
+    const char* emptyText;
+    size_t first; // top visible row
+    ListRow window[LIST_VIEW_WINDOW_ROWS];
+    size_t windowFirst;
+    size_t windowCount;
+    bool windowValid;
+};
+
 class Menu {
 public:
     Menu(const char* backBtnText = "< Back  ");
@@ -585,6 +725,9 @@ public:
             checkboxes[i]->setChecked(false);
         }
         checkboxes[value]->setChecked(true);
+        if(this->value != value) {
+            invalidateUI();
+        }
         this->value = value;
     }
 
@@ -658,6 +801,12 @@ public:
     void render(ScreenDisplay *display, DisplayUiState* state, int16_t x, int16_t y) {
         this->x = this->targetX * lpf + (1.0 - lpf) * this->x;
         this->y = this->targetY * lpf + (1.0 - lpf) * this->y;
+        if(fabs(this->targetX - this->x) < 0.5 && fabs(this->targetY - this->y) < 0.5) { // settled
+            this->x = this->targetX;
+            this->y = this->targetY;
+        } else {
+            invalidateUI(); // keep animating
+        }
         x -= int(this->x);
         y -= int(this->y);
         if(y <= -1) {
@@ -0,0 +1,110 @@
+/**
+ * @file Arduino.h
+ * @brief Just enough of the Arduino core and FreeRTOS to build the display, gui, LedMatrix and JsonBuilder libraries on a PC
+ */
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <climits>
+#include <string>
+#include <algorithm>
+
+using std::min;
+using std::max;
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define PROGMEM
+#define pgm_read_byte(address) (*(const uint8_t*) (address))
+#define _min(a, b) ((a) < (b) ? (a) : (b))
+#define _max(a, b) ((a) > (b) ? (a) : (b))
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define ANALOG 3
+
+/**
+ * Emulated clock. Only advances through setMillis(), so renders are reproducible
+ */
+extern unsigned long hostMillis;
+inline unsigned long millis() { return hostMillis; }
+inline unsigned long micros() { return hostMillis * 1000; }
+inline void setMillis(unsigned long ms) { hostMillis = ms; }
+inline void delay(unsigned long ms) {}
+inline void yield() {}
+inline void pinMode(int pin, int mode) {}
+inline void digitalWrite(int pin, int value) {}
+
+/**
+ * FreeRTOS as far as SSD1306Wire uses it. There is only one task, so locks always succeed and tasks are never created
+ */
+typedef void* TaskHandle_t;
+typedef void* SemaphoreHandle_t;
+typedef int portMUX_TYPE;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portMAX_DELAY 0xFFFFFFFF
+#define pdTRUE 1
+#define pdPASS 1
+#define pdFAIL 0
+inline void portENTER_CRITICAL(portMUX_TYPE* mux) {}
+inline void portEXIT_CRITICAL(portMUX_TYPE* mux) {}
+inline SemaphoreHandle_t xSemaphoreCreateMutex() { return nullptr; }
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, uint32_t ticks) { return pdTRUE; }
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) { return pdTRUE; }
+inline void vSemaphoreDelete(SemaphoreHandle_t semaphore) {}
+inline BaseType_t xTaskCreatePinnedToCore(void (*task)(void*), const char* name, uint32_t stack, void* parameter, UBaseType_t priority,
+                                          TaskHandle_t* handle, BaseType_t core) { return pdFAIL; }
+inline void vTaskDelete(TaskHandle_t task) {}
+inline void xTaskNotifyGive(TaskHandle_t task) {}
+inline uint32_t ulTaskNotifyTake(BaseType_t clear, uint32_t ticks) { return 0; }
+
+class String {
+public:
+    String() {}
+    String(const char* str) : str(str ? str : "") {}
+    String(int value) : str(std::to_string(value)) {}
+    String(unsigned int value) : str(std::to_string(value)) {}
+    String(long value) : str(std::to_string(value)) {}
+    String(unsigned long value) : str(std::to_string(value)) {}
+    String(double value, int decimals = 2) {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%.*f", decimals, value);
+        str = buffer;
+    }
+    const char* c_str() const { return str.c_str(); }
+    unsigned int length() const { return str.length(); }
+    char charAt(unsigned int index) const { return str[index]; }
+    char operator[](unsigned int index) const { return str[index]; }
+    void toCharArray(char* buffer, unsigned int size) const {
+        if(size == 0) return;
+        strncpy(buffer, str.c_str(), size);
+        buffer[size - 1] = 0;
+    }
+    bool concat(const char* data, unsigned int size) { str.append(data, size); return true; }
+    bool reserve(unsigned int size) { str.reserve(size); return true; }
+    String& operator+=(const String& other) { str += other.str; return *this; }
+    String operator+(const String& other) const { String result = *this; result += other; return result; }
+    bool operator==(const String& other) const { return str == other.str; }
+    bool operator!=(const String& other) const { return str != other.str; }
+private:
+    std::string str;
+};
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* data, size_t size) {
+        size_t written = 0;
+        while(size--) written += write(*data++);
+        return written;
+    }
+    size_t write(const char* str) { return write((const uint8_t*) str, strlen(str)); }
+};
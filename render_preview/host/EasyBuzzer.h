@@ -0,0 +1,15 @@
+/**
+ * @file EasyBuzzer.h
+ * @brief Silent buzzer for the gui beeps
+ */
+#pragma once
+#include <Arduino.h>
+
+class EasyBuzzerClass {
+public:
+    void beep(unsigned int frequency, unsigned int onDuration = 0, unsigned int offDuration = 0, unsigned int beeps = 1, unsigned int pauseDuration = 0, unsigned int sequences = 1, void (*finishedCallback)() = nullptr) {}
+    void stopBeep() {}
+    void update() {}
+};
+
+extern EasyBuzzerClass EasyBuzzer;
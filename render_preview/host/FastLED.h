@@ -0,0 +1,48 @@
+/**
+ * @file FastLED.h
+ * @brief CRGB with FastLED's saturating math. Nothing is sent anywhere
+ */
+#pragma once
+#include <Arduino.h>
+
+inline uint8_t qadd8(uint8_t a, uint8_t b) { return min(int(a) + int(b), 255); }
+inline uint8_t qmul8(uint8_t a, uint8_t b) { return min(int(a) * int(b), 255); }
+
+struct CRGB {
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+
+    CRGB() : r(0), g(0), b(0) {}
+    CRGB(uint8_t r, uint8_t g, uint8_t b) : r(r), g(g), b(b) {}
+    CRGB(uint32_t colorCode) : r(colorCode >> 16), g(colorCode >> 8), b(colorCode) {}
+
+    CRGB& operator+=(const CRGB& other) {
+        r = qadd8(r, other.r);
+        g = qadd8(g, other.g);
+        b = qadd8(b, other.b);
+        return *this;
+    }
+    CRGB& operator*=(uint8_t d) {
+        r = qmul8(r, d);
+        g = qmul8(g, d);
+        b = qmul8(b, d);
+        return *this;
+    }
+
+    enum HTMLColorCode {
+        Black = 0x000000,
+        Red = 0xFF0000,
+        White = 0xFFFFFF,
+        Yellow = 0xFFFF00,
+    };
+};
+
+inline CRGB operator+(const CRGB& a, const CRGB& b) { CRGB result = a; result += b; return result; }
+inline CRGB operator*(const CRGB& a, uint8_t d) { CRGB result = a; result *= d; return result; }
+
+inline void fill_solid(CRGB* leds, int numToFill, const CRGB& color) {
+    for (int i = 0; i < numToFill; i++) {
+        leds[i] = color;
+    }
+}
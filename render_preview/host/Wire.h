@@ -0,0 +1,40 @@
+/**
+ * @file Wire.h
+ * @brief I2C master that counts the bytes a transfer puts on the bus and hands every finished transmission to a callback
+ */
+#pragma once
+#include <Arduino.h>
+#include <vector>
+
+class TwoWire {
+public:
+    size_t bytes = 0; // address bytes included
+    size_t transmissions = 0;
+    void (*onTransmission)(const uint8_t* data, size_t size) = nullptr; // without the address byte
+
+    bool begin(int sda = -1, int scl = -1, uint32_t frequency = 0) { return true; }
+    bool end() { return true; }
+
+    void beginTransmission(uint8_t address) {
+        data.clear();
+    }
+
+    size_t write(uint8_t value) {
+        data.push_back(value);
+        return 1;
+    }
+
+    uint8_t endTransmission(bool sendStop = true) {
+        bytes += 1 + data.size();
+        transmissions++;
+        if(onTransmission) {
+            onTransmission(data.data(), data.size());
+        }
+        return 0;
+    }
+
+private:
+    std::vector<uint8_t> data;
+};
+
+extern TwoWire Wire;
@@ -0,0 +1,156 @@
+/**
+ * Host benchmark of lib/JsonBuilder. Serialises the same triggers into each output mode and prints throughput and
+ * heap allocations per trigger. Allocations are counted by replacing the global operator new, so only the builder and the
+ * host String stub are counted. The device String allocates on every growth, the numbers here are a lower bound
+ *
+ * build (from the repository root):
+ *   g++ -std=gnu++11 -O2 -Irender_preview/host -Ilib/JsonBuilder/src render_preview/json_bench.cpp -o render_preview/json_bench
+ *
+ * usage: json_bench [triggers]   default 200000
+ */
+#include <Arduino.h>
+#include <new>
+#include <chrono>
+
+typedef int32_t timeMs_t;
+
+/**
+ * Same layout as in include/SPIFFSLogic.h, which needs SPIFFS
+ */
+struct Trigger {
+    timeMs_t timeMs;
+    uint16_t millimeters;
+    uint8_t triggerType;
+};
+
+#include <JsonBuilder.h>
+
+#define LIVE_PIECE_TRIGGERS 32 // like STATS_TRIGGERS_PER_PIECE in WiFiLogic.h
+
+static size_t allocations = 0;
+
+void* operator new(size_t size) {
+    allocations++;
+    void* p = malloc(size ? size : 1);
+    if(!p) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+/**
+ * Counts and drops everything, like a socket that never blocks
+ */
+class NullPrint : public Print {
+public:
+    size_t bytes = 0;
+
+    size_t write(uint8_t c) {
+        bytes++;
+        return 1;
+    }
+
+    size_t write(const uint8_t* data, size_t size) {
+        bytes += size;
+        return size;
+    }
+};
+
+struct Result {
+    size_t bytes;
+    size_t allocations;
+    double seconds;
+};
+
+static void writeTriggers(JsonBuilder& builder, const Trigger* triggers, size_t count) {
+    builder.startArray();
+    for (size_t i = 0; i < count; i++) {
+        builder.insertTriggerObj(triggers[i]);
+    }
+    builder.endArray();
+}
+
+static void printResult(const char* name, const Result& result, size_t triggers) {
+    printf("%-16s %7.1f MB/s %9zu bytes %6zu allocations (%.5f per trigger)\n", name, result.bytes / result.seconds / 1e6,
+           result.bytes, result.allocations, double(result.allocations) / triggers);
+}
+
+template<typename F>
+static Result measure(F run) {
+    const size_t allocationsBefore = allocations;
+    const auto start = std::chrono::steady_clock::now();
+    const size_t bytes = run();
+    const auto end = std::chrono::steady_clock::now();
+    return { bytes, allocations - allocationsBefore, std::chrono::duration<double>(end - start).count() };
+}
+
+int main(int argc, char** argv) {
+    const size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200000;
+    if(count == 0) {
+        printf("usage: %s [triggers]\n", argv[0]);
+        return 1;
+    }
+    Trigger* triggers = (Trigger*) malloc(count * sizeof(Trigger));
+    uint32_t seed = 1;
+    for (size_t i = 0; i < count; i++) {
+        seed = seed * 1103515245 + 12345;
+        triggers[i].timeMs = timeMs_t(i * 1500 + seed % 1000);
+        triggers[i].millimeters = uint16_t(seed >> 16);
+        triggers[i].triggerType = uint8_t(seed % 6);
+    }
+    const size_t bufferSize = count * 64;
+    char* buffer = (char*) malloc(bufferSize);
+
+    printf("%zu triggers\n", count);
+    Result string = measure([&]() {
+        JsonBuilder builder;
+        writeTriggers(builder, triggers, count);
+        return size_t(builder.length());
+    });
+    printResult("String", string, count);
+
+    Result reserved = measure([&]() {
+        JsonBuilder builder;
+        builder.reserve(bufferSize);
+        writeTriggers(builder, triggers, count);
+        return size_t(builder.length());
+    });
+    printResult("String reserved", reserved, count);
+
+    Result pieces = measure([&]() { // streamed responses: one String reused for every piece. Pieces are joined by commas
+        JsonBuilder builder;
+        size_t bytes = 0;
+        for (size_t i = 0; i < count; i += LIVE_PIECE_TRIGGERS) {
+            builder.clearJson();
+            writeTriggers(builder, triggers + i, min(size_t(LIVE_PIECE_TRIGGERS), count - i));
+            bytes += builder.length();
+        }
+        return bytes;
+    });
+    printResult("String pieces", pieces, count);
+
+    Result fixed = measure([&]() {
+        JsonBuilder builder(buffer, bufferSize);
+        writeTriggers(builder, triggers, count);
+        return builder.overflowed() ? 0 : builder.length();
+    });
+    printResult("buffer", fixed, count);
+
+    NullPrint sink;
+    Result printed = measure([&]() {
+        JsonBuilder builder(sink);
+        writeTriggers(builder, triggers, count);
+        return builder.length();
+    });
+    printResult("Print sink", printed, count);
+
+    free(buffer);
+    free(triggers);
+    const bool same = string.bytes == fixed.bytes && string.bytes == printed.bytes && string.bytes == reserved.bytes;
+    if(!same) {
+        printf("output length differs between modes\n");
+    }
+    return same ? 0 : 1;
+}
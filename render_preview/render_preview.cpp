@@ -0,0 +1,537 @@
+/**
+ * Host build of LedMatrix and of the OLED drawing code (ScreenDisplay and the gui menus). Renders a fixed set of frames into
+ * in-memory framebuffers, compares them with the golden snapshots in render_preview/golden, writes them as PPM and times every frame.
+ * Render path changes can be checked for exact pixels and speed without hardware. Only the stubs in host/ stand in for the
+ * Arduino core, FreeRTOS, Wire, FastLED and EasyBuzzer. The overlay is drawn by drawOverlay() from include/Overlay.h like msOverlay does.
+ * The other frames in GuiLogic.h need the whole firmware and are not included
+ *
+ * build (from the repository root):
+ *   g++ -std=gnu++11 -O2 -Irender_preview/host -Ilib/DISPLAY/src -Ilib/gui -Ilib/LedMatrix/src -Iinclude render_preview/render_preview.cpp \
+ *     lib/DISPLAY/src/HT_Display.cpp lib/DISPLAY/src/HT_DisplayUi.cpp lib/gui/gui.cpp lib/LedMatrix/src/LedMatrix.cpp -o render_preview/render_preview
+ *
+ * check (from the repository root, exit code 1 if any pixel differs from the goldens or a snapshot could not be written):
+ *   render_preview/render_preview --bench 0
+ *
+ * usage: render_preview [--out dir] [--compare dir] [--update] [--bench iterations] [--bytes frames]
+ *   --out      write <frame>.ppm for every frame, scaled up for viewing
+ *   --compare  compare with <dir>/<frame>.ppm instead of the goldens, e.g. written by a build of the previous commit
+ *   --update   rewrite the goldens instead of comparing. Only after checking the differences
+ *   --bench    render every frame this often and print the time per frame. Default 2000, 0 skips the timing
+ *   --bytes    instead of the frames above, send this many frames of each OLED scenario through SSD1306Wire::flush() with a
+ *              counting Wire and print the bytes on the bus per frame, for the dirty rectangles and for a single bounding box
+ */
+#include <Arduino.h>
+#include <FastLED.h>
+#include <EasyBuzzer.h>
+#include <HT_Display.h>
+#include <HT_SSD1306Wire.h>
+#include <gui.h>
+#include <LedMatrix.h>
+#include <Overlay.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#define GOLDEN_DIR "render_preview/golden" // one pixel per framebuffer pixel
+#define OLED_SCALE 4 // pixels per OLED pixel in the snapshots
+#define LED_SCALE 8
+#define LED_WIDTH 32
+#define LED_HEIGHT 8
+
+unsigned long hostMillis = 0;
+EasyBuzzerClass EasyBuzzer;
+TwoWire Wire;
+
+/**
+ * ScreenDisplay without a panel. display() keeps the frame in buffer
+ */
+class HostDisplay : public ScreenDisplay {
+public:
+    HostDisplay() {
+        setGeometry(GEOMETRY_128_64);
+        this->displayType = OLED;
+    }
+
+    ~HostDisplay() {
+        end(); // ~ScreenDisplay() can't call getBufferOffset() anymore
+    }
+
+    void display() {}
+
+protected:
+    bool connect() {
+        return true;
+    }
+
+    int getBufferOffset() {
+        return 0;
+    }
+};
+
+/**
+ * Same as pixelConverter() in GuiLogic.h
+ */
+constexpr uint16_t pixelConverter(uint16_t x, uint16_t y) {
+    return (8 * 31) - x * 8 + (x % 2 == 0 ? y : 7 - y);
+}
+
+HostDisplay oled;
+CRGB leds[LED_WIDTH * LED_HEIGHT];
+LedMatrix matrix(leds, LED_WIDTH * LED_HEIGHT, LedPixelMap<pixelConverter, LED_WIDTH, LED_HEIGHT>::pixels);
+
+Menu* setupMenu;
+Menu* viewerMenu;
+ListView* viewerList;
+Select* isDisplaySelect;
+Select* stationTypeSelect;
+
+struct Image {
+    int width;
+    int height;
+    std::vector<uint8_t> rgb;
+};
+
+Image oledImage() {
+    Image image { 128, 64, std::vector<uint8_t>(128 * 64 * 3) };
+    for (int y = 0; y < 64; y++) {
+        for (int x = 0; x < 128; x++) {
+            const uint8_t value = oled.buffer[x + (y / 8) * 128] & (1 << (y & 7)) ? 255 : 0;
+            memset(&image.rgb[(x + y * 128) * 3], value, 3);
+        }
+    }
+    return image;
+}
+
+Image ledImage() {
+    Image image { LED_WIDTH, LED_HEIGHT, std::vector<uint8_t>(LED_WIDTH * LED_HEIGHT * 3) };
+    for (int y = 0; y < LED_HEIGHT; y++) {
+        for (int x = 0; x < LED_WIDTH; x++) {
+            const CRGB& led = leds[pixelConverter(x, y)];
+            uint8_t* pixel = &image.rgb[(x + y * LED_WIDTH) * 3];
+            pixel[0] = led.r;
+            pixel[1] = led.g;
+            pixel[2] = led.b;
+        }
+    }
+    return image;
+}
+
+/**
+ * Frames like handleLEDS() draws them
+ */
+void renderLEDIntro() {
+    fill_solid(leds, LED_WIDTH * LED_HEIGHT, CRGB::Black);
+    matrix.print("GO SKATE!", 1, 1, CRGB::White, FONT_SIZE_SMALL + FONT_SETTINGS_DEFAULT);
+}
+
+void renderLEDTimeBig() {
+    fill_solid(leds, LED_WIDTH * LED_HEIGHT, CRGB::Black);
+    matrix.printTimeBig(6, 0, 83456, false);
+    matrix.print("3", 0, 0, CRGB::Yellow, FONT_SIZE_SMALL + FONT_SETTINGS_DEFAULT);
+}
+
+void renderLEDTimeBigRunning() {
+    fill_solid(leds, LED_WIDTH * LED_HEIGHT, CRGB::Black);
+    matrix.printTimeBig(6, 0, 9300, true);
+    matrix.print("4", 0, 0, CRGB::Yellow, FONT_SIZE_SMALL + FONT_SETTINGS_DEFAULT);
+}
+
+void renderLEDTimeSmall() {
+    fill_solid(leds, LED_WIDTH * LED_HEIGHT, CRGB::Black);
+    matrix.printTimeSmall(10, 2, 754321, false);
+    matrix.print("12", 0, 0, CRGB::Yellow, FONT_SIZE_SMALL + FONT_SETTINGS_DEFAULT);
+}
+
+void renderLEDSpeedBig() {
+    fill_solid(leds, LED_WIDTH * LED_HEIGHT, CRGB::Black);
+    matrix.printSpeedBig(6, 0, 23.45);
+}
+
+void renderLEDSpeedSmall() {
+    fill_solid(leds, LED_WIDTH * LED_HEIGHT, CRGB::Black);
+    matrix.printSpeedSmall(10, 2, 8.07);
+}
+
+/**
+ * OLED frames
+ */
+void renderOLEDText() {
+    oled.clear();
+    oled.setColor(WHITE);
+    oled.setFont(ArialMT_Plain_10);
+    oled.setTextAlignment(TEXT_ALIGN_LEFT);
+    oled.drawString(0, 0, "Lap 12");
+    oled.setTextAlignment(TEXT_ALIGN_RIGHT);
+    oled.drawString(128, 0, "400m");
+    oled.setFont(ArialMT_Plain_24);
+    oled.setTextAlignment(TEXT_ALIGN_CENTER);
+    oled.drawString(64, 14, "1:23.456");
+    oled.setFont(ArialMT_Plain_10);
+    oled.drawStringMaxWidth(64, 36, 120, "Best 1:21.002 avg 1:24.310");
+    oled.drawProgressBar(0, 59, 127, 4, 40);
+}
+
+void renderOLEDMenu() {
+    oled.clear();
+    setupMenu->render(&oled, nullptr, 0, 0);
+}
+
+void renderOLEDList() {
+    oled.clear();
+    viewerMenu->render(&oled, nullptr, 0, 0);
+}
+
+/**
+ * Setup frame with the overlay like msOverlay draws it, for a station and for the display
+ */
+void renderOLEDOverlay(int freeStorage, bool masterConnected, size_t outboxSize, uint8_t isDisplay) {
+    oled.clear();
+    oled.setTextAlignment(TEXT_ALIGN_CENTER_BOTH);
+    oled.setFont(ArialMT_Plain_16);
+    oled.drawStringMaxWidth(64, 32, 100, "Setup");
+    isDisplaySelect->setValue(isDisplay);
+    drawOverlay(&oled, freeStorage, masterConnected, outboxSize, isDisplaySelect, stationTypeSelect);
+}
+
+void renderOLEDOverlayStation() {
+    renderOLEDOverlay(-1, true, 3, 0);
+}
+
+void renderOLEDOverlayStationOffline() {
+    renderOLEDOverlay(-1, false, 0, 0);
+}
+
+void renderOLEDOverlayDisplay() {
+    renderOLEDOverlay(87, false, 0, 1);
+}
+
+size_t viewerRowCount() {
+    return 250;
+}
+
+size_t viewerRows(size_t first, size_t count, ListRow* rows) {
+    for (size_t i = 0; i < count; i++) {
+        const size_t number = viewerRowCount() - first - i;
+        rows[i].separator = number % 4 == 0;
+        if(rows[i].separator) {
+            snprintf(rows[i].label, LIST_VIEW_LABEL_SIZE, "Lap %u", unsigned(number / 4));
+            snprintf(rows[i].value, LIST_VIEW_VALUE_SIZE, "1:%02u.%03u", unsigned(number % 60), unsigned(number * 37 % 1000));
+        } else {
+            snprintf(rows[i].label, LIST_VIEW_LABEL_SIZE, "# %u %um", unsigned(number % 4), unsigned(number % 4 * 100));
+            snprintf(rows[i].value, LIST_VIEW_VALUE_SIZE, "%u.%03us", unsigned(10 + number % 20), unsigned(number * 71 % 1000));
+        }
+    }
+    return count;
+}
+
+void setupGui() {
+    setupMenu = new Menu();
+    setupMenu->addItem(new TextItem("Setup"));
+    setupMenu->addItem(new NumberField("Brightness", "%", 1, 5, 100, 0, 30));
+    setupMenu->addItem(new NumberField("Battery life", "h", 1, 2, 100, 0, 16));
+    setupMenu->addItem(new TimeInput("Target", 0, 3600000, 100, 83400));
+    setupMenu->addItem(new CheckBox("Upload", false, true));
+    setupMenu->addItem(new Button("Upload now"));
+    viewerMenu = new Menu();
+    viewerList = new ListView(viewerRowCount, viewerRows);
+    viewerMenu->addItem(viewerList);
+    viewerList->setHighlighted(true);
+    for (int i = 0; i < 7; i++) {
+        viewerList->handleEvent(PROCESSED_EVENT_SCROLL_DOWN);
+    }
+    // options as in GuiLogic.h
+    isDisplaySelect = new Select("Station type");
+    isDisplaySelect->addOption("Laser/Reflector", "Laser");
+    isDisplaySelect->addOption("Display station", "Display");
+    stationTypeSelect = new Select("Function");
+    stationTypeSelect->addOption("Start + finish", "S+F");
+    stationTypeSelect->addOption("Only start", "Start");
+    stationTypeSelect->addOption("checkpoint", "Checkpoint");
+    stationTypeSelect->addOption("Only finish", "Finish");
+    stationTypeSelect->addOption("Parcour start", "Parc. start");
+    stationTypeSelect->addOption("Parcour finish", "Parc. finish");
+    stationTypeSelect->setValue(3);
+}
+
+struct PreviewFrame {
+    const char* name;
+    void (*render)();
+    Image (*snapshot)();
+};
+
+PreviewFrame frames[] = {
+    { "led_intro", renderLEDIntro, ledImage },
+    { "led_time_big", renderLEDTimeBig, ledImage },
+    { "led_time_big_running", renderLEDTimeBigRunning, ledImage },
+    { "led_time_small", renderLEDTimeSmall, ledImage },
+    { "led_speed_big", renderLEDSpeedBig, ledImage },
+    { "led_speed_small", renderLEDSpeedSmall, ledImage },
+    { "oled_text", renderOLEDText, oledImage },
+    { "oled_menu", renderOLEDMenu, oledImage },
+    { "oled_list", renderOLEDList, oledImage },
+    { "oled_overlay_station", renderOLEDOverlayStation, oledImage },
+    { "oled_overlay_station_offline", renderOLEDOverlayStationOffline, oledImage },
+    { "oled_overlay_display", renderOLEDOverlayDisplay, oledImage },
+};
+
+/**
+ * SSD1306Wire with the counting Wire. Used by --bytes only
+ */
+class HostPanel : public SSD1306Wire {
+public:
+    HostPanel() : SSD1306Wire(0x3c, 500000, -1, -1) {}
+
+    ~HostPanel() {
+        end();
+    }
+};
+
+/**
+ * SSD1306 display RAM in horizontal addressing mode, written from what SSD1306Wire sends.
+ * Only COLUMNADDR, PAGEADDR and data are interpreted, no other command takes 0x21 or 0x22 as argument
+ */
+struct EmulatedPanel {
+    uint8_t ram[128 * 8];
+    uint8_t x0 = 0, x1 = 127, p0 = 0, p1 = 7;
+    uint8_t x = 0, page = 0;
+    uint8_t command = 0;
+    uint8_t arguments[2];
+    uint8_t argumentCount = 0;
+} emulatedPanel;
+
+void panelTransmission(const uint8_t* data, size_t size) {
+    EmulatedPanel& panel = emulatedPanel;
+    if(size == 2 && data[0] == 0x80) {
+        if(panel.command) {
+            panel.arguments[panel.argumentCount++] = data[1];
+            if(panel.argumentCount < 2) return;
+            if(panel.command == COLUMNADDR) {
+                panel.x0 = panel.x = panel.arguments[0];
+                panel.x1 = panel.arguments[1];
+            } else {
+                panel.p0 = panel.page = panel.arguments[0];
+                panel.p1 = panel.arguments[1];
+            }
+            panel.command = 0;
+        } else if(data[1] == COLUMNADDR || data[1] == PAGEADDR) {
+            panel.command = data[1];
+            panel.argumentCount = 0;
+        }
+    } else if(size > 0 && data[0] == 0x40) {
+        for (size_t i = 1; i < size; i++) {
+            panel.ram[panel.x + panel.page * 128] = data[i];
+            if(++panel.x > panel.x1) {
+                panel.x = panel.x0;
+                if(++panel.page > panel.p1) panel.page = panel.p0;
+            }
+        }
+    }
+}
+
+/**
+ * Bus bytes of the single bounding box of all changes that flush() sent before the dirty rectangles
+ */
+size_t boundingBoxBytes(const uint8_t* frame, const uint8_t* previous) {
+    SSD1306Rect bounds = { UINT8_MAX, 0, UINT8_MAX, 0 };
+    for (uint8_t page = 0; page < 8; page++) {
+        for (uint8_t x = 0; x < 128; x++) {
+            if(frame[x + page * 128] == previous[x + page * 128]) continue;
+            const SSD1306Rect change = { x, x, page, page };
+            bounds = bounds.x0 == UINT8_MAX ? change : bounds.merged(change);
+        }
+    }
+    return bounds.x0 == UINT8_MAX ? 0 : bounds.cost();
+}
+
+struct BytesScenario {
+    const char* name;
+    void (*draw)(ScreenDisplay& display, int frame);
+};
+
+std::mt19937 bytesRandom;
+
+BytesScenario bytesScenarios[] = {
+    { "overlay text + indicator dots", [](ScreenDisplay& display, int frame) {
+        char text[32];
+        display.setFont(ArialMT_Plain_10);
+        snprintf(text, sizeof(text), "Free storage: %i%%", 90 - frame % 3);
+        display.drawString(0, 0, text);
+        display.fillRect(7, 13, 114, 1);
+        for (int i = 0; i < 3; i++) {
+            if(i == frame % 3) {
+                display.fillRect(100 + i * 8, 58, 5, 5);
+            } else {
+                display.drawRect(100 + i * 8, 58, 5, 5);
+            }
+        }
+        display.setFont(ArialMT_Plain_16);
+        display.drawString(40, 24, "Setup");
+    } },
+    { "menu scroll", [](ScreenDisplay& display, int frame) {
+        display.setFont(ArialMT_Plain_10);
+        for (int i = 0; i < 8; i++) {
+            display.drawString(12, i * 15 - frame * 3 % 30, "Menu item");
+        }
+    } },
+    { "stopwatch digits", [](ScreenDisplay& display, int frame) {
+        char text[32];
+        display.setFont(ArialMT_Plain_24);
+        snprintf(text, sizeof(text), "0:%02i.%i", frame / 10 % 60, frame % 10);
+        display.drawString(20, 20, text);
+        display.setFont(ArialMT_Plain_10);
+        display.drawString(0, 0, "Connected");
+    } },
+    { "random full screen", [](ScreenDisplay& display, int frame) {
+        for (int i = 0; i < 40; i++) {
+            const int height = bytesRandom() % 20;
+            const int width = bytesRandom() % 40;
+            const int y = bytesRandom() % 64;
+            const int x = bytesRandom() % 128;
+            display.fillRect(x, y, width, height);
+        }
+    } },
+};
+
+/**
+ * Sends the frames of every scenario through SSD1306Wire::flush() and prints the bus bytes per frame.
+ * The emulated panel has to match the framebuffer after every frame
+ * @return false if it did not
+ */
+bool measureFlushBytes(int frameCount) {
+    HostPanel panel;
+    Wire.onTransmission = panelTransmission;
+    panel.init();
+    bool matches = true;
+    printf("%-30s %12s %12s %14s\n", "bytes per frame", "bounding box", "dirty rects", "transmissions");
+    for (BytesScenario& scenario : bytesScenarios) {
+        bytesRandom.seed(7);
+        size_t boundingBox = 0;
+        const size_t bytesBefore = Wire.bytes;
+        const size_t transmissionsBefore = Wire.transmissions;
+        bool scenarioMatches = true;
+        for (int frame = 0; frame < frameCount; frame++) {
+            panel.clear();
+            scenario.draw(panel, frame);
+            boundingBox += boundingBoxBytes(panel.buffer, emulatedPanel.ram);
+            panel.display();
+            scenarioMatches = scenarioMatches && !memcmp(emulatedPanel.ram, panel.buffer, sizeof(emulatedPanel.ram));
+        }
+        printf("%-30s %12.1f %12.1f %14.1f%s\n", scenario.name, double(boundingBox) / frameCount, double(Wire.bytes - bytesBefore) / frameCount,
+               double(Wire.transmissions - transmissionsBefore) / frameCount, scenarioMatches ? "" : "  panel differs from the framebuffer");
+        matches = matches && scenarioMatches;
+    }
+    Wire.onTransmission = nullptr;
+    return matches;
+}
+
+bool writePPM(const std::string& path, const Image& image, int scale) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if(!file) return false;
+    fprintf(file, "P6\n%d %d\n255\n", image.width * scale, image.height * scale);
+    for (int y = 0; y < image.height * scale; y++) {
+        for (int x = 0; x < image.width * scale; x++) {
+            fwrite(&image.rgb[(x / scale + y / scale * image.width) * 3], 1, 3, file);
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+/**
+ * Reads a snapshot written by writePPM() at any scale back at one pixel per framebuffer pixel
+ */
+bool readPPM(const std::string& path, const Image& like, Image& image) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if(!file) return false;
+    int width, height, maxValue;
+    bool valid = fscanf(file, "P6 %d %d %d", &width, &height, &maxValue) == 3 && fgetc(file) != EOF && maxValue == 255;
+    const int scale = valid ? width / like.width : 0;
+    valid = valid && scale > 0 && width == like.width * scale && height == like.height * scale;
+    std::vector<uint8_t> scaled(valid ? width * height * 3 : 0);
+    if(!valid || fread(scaled.data(), 1, scaled.size(), file) != scaled.size()) {
+        fclose(file);
+        return false;
+    }
+    fclose(file);
+    image = Image { like.width, like.height, std::vector<uint8_t>(like.rgb.size()) };
+    for (int y = 0; y < image.height; y++) {
+        for (int x = 0; x < image.width; x++) {
+            memcpy(&image.rgb[(x + y * image.width) * 3], &scaled[(x * scale + y * scale * width) * 3], 3);
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const char* outDir = nullptr;
+    const char* compareDir = GOLDEN_DIR;
+    bool update = false;
+    int iterations = 2000;
+    int bytesFrames = 0;
+    for (int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "--out") && i + 1 < argc) {
+            outDir = argv[++i];
+        } else if(!strcmp(argv[i], "--compare") && i + 1 < argc) {
+            compareDir = argv[++i];
+        } else if(!strcmp(argv[i], "--update")) {
+            update = true;
+        } else if(!strcmp(argv[i], "--bench") && i + 1 < argc) {
+            iterations = atoi(argv[++i]);
+        } else if(!strcmp(argv[i], "--bytes") && i + 1 < argc) {
+            bytesFrames = atoi(argv[++i]);
+        } else {
+            printf("usage: %s [--out dir] [--compare dir] [--update] [--bench iterations] [--bytes frames]\n", argv[0]);
+            return 2;
+        }
+    }
+    if(bytesFrames > 0) {
+        return measureFlushBytes(bytesFrames) ? 0 : 1;
+    }
+    oled.init();
+    setupGui();
+
+    int failed = 0; // differing frames and failed writes
+    for (PreviewFrame& frame : frames) {
+        for (int i = 0; i < 100; i++) { // let menu animations settle
+            frame.render();
+        }
+        const Image image = frame.snapshot();
+        const int scale = image.width == LED_WIDTH ? LED_SCALE : OLED_SCALE;
+        printf("%-30s", frame.name);
+        if(outDir && !writePPM(std::string(outDir) + "/" + frame.name + ".ppm", image, scale)) {
+            printf(" could not write to %s", outDir);
+            failed++;
+        }
+        if(update) {
+            if(!writePPM(std::string(GOLDEN_DIR) + "/" + frame.name + ".ppm", image, 1)) {
+                printf(" could not write to %s", GOLDEN_DIR);
+                failed++;
+            } else {
+                printf(" updated");
+            }
+        } else {
+            Image reference;
+            if(!readPPM(std::string(compareDir) + "/" + frame.name + ".ppm", image, reference)) {
+                printf(" no reference in %s", compareDir);
+                failed++;
+            } else {
+                int pixels = 0;
+                for (size_t i = 0; i < image.rgb.size(); i += 3) {
+                    if(memcmp(&image.rgb[i], &reference.rgb[i], 3)) pixels++;
+                }
+                printf(pixels ? " %5d pixels differ" : " identical", pixels);
+                if(pixels) failed++;
+            }
+        }
+        if(iterations > 0) {
+            const auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < iterations; i++) {
+                frame.render();
+            }
+            const double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / iterations;
+            printf(" %8.2f us/frame", us);
+        }
+        printf("\n");
+    }
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,144 @@
+# Decodes a radio capture downloaded from http://<device>/capture.bin and replays it through the master logic.
+# The resulting triggers are written as a session file (same format as the N.rt files on the display).
+#
+# usage: python replay_capture.py capture.bin [-o replay.rt] [--network N] [--dump]
+
+import argparse
+import math
+import struct
+from collections import deque
+
+# keep in sync with include/RadioCapture.h
+RECORD = struct.Struct("<IBBbbq40s")
+CAPTURE_TX = 1
+CAPTURE_CRC_ERROR = 2
+CAPTURE_TRUNCATED = 4
+
+# keep in sync with include/SPIFFSLogic.h, and MasterSlaveLogic.h
+TRIGGER = struct.Struct("<iHBx")
+TRIGGER_TYPE_PARCOUR_FINISH = 5
+TRIGGER_BATCH_MAX = 4
+MAX_TRIGGER_COUNT_IN_CACHE = 52
+MAX_TRIGGER_AHEAD_MS = 15000  # MASTER_TRIGGER_MAX_AHEAD_MS
+MAX_TRIGGER_AGE_MS = 12 * 3600000  # MASTER_TRIGGER_MAX_AGE_MS
+
+
+def time_on_air_ms(size, sf=9, bw=125.0, cr=7, preamble=8):
+    """LoRa airtime for the RadioLib defaults used by beginRadio(). Explicit header, CRC on, cr is the 4/cr denominator"""
+    symbol_ms = (2 ** sf) / bw
+    low_data_rate = 1 if symbol_ms > 16 else 0
+    payload_symbols = 8 + max(math.ceil((8 * size - 4 * sf + 28 + 16) / (4 * (sf - 2 * low_data_rate))) * cr, 0)
+    return (preamble + 4.25 + payload_symbols) * symbol_ms
+
+
+def read_capture(path):
+    records = []
+    with open(path, "rb") as file:
+        while True:
+            chunk = file.read(RECORD.size)
+            if len(chunk) < RECORD.size:
+                break
+            seq, flags, size, rssi, snr, time_us, data = RECORD.unpack(chunk)
+            if seq == 0:
+                continue
+            records.append({
+                "seq": seq,
+                "flags": flags,
+                "size": size,
+                "rssi": rssi,
+                "snr": snr,
+                "timeUs": time_us,
+                "data": data[:min(size, len(data))],
+            })
+    records.sort(key=lambda r: r["seq"])
+    return records
+
+
+def dump(records):
+    for r in records:
+        direction = "TX" if r["flags"] & CAPTURE_TX else "RX"
+        notes = []
+        if r["flags"] & CAPTURE_CRC_ERROR:
+            notes.append("CRC")
+        if r["flags"] & CAPTURE_TRUNCATED:
+            notes.append("truncated")
+        print("#%-6i %12.3fms %s len=%-3i rssi=%-4i snr=%-3i %s %s" % (
+            r["seq"], r["timeUs"] / 1000.0, direction, r["size"], r["rssi"], r["snr"], r["data"].hex(), " ".join(notes)))
+
+
+def guess_network(records):
+    """The network of the first time sync this device sent"""
+    for r in records:
+        if r["flags"] & CAPTURE_TX and r["size"] == 5:
+            return r["data"][0]
+    return None
+
+
+def replay_master(records, network):
+    """Mirrors radioReceived() on the master. Returns the triggers masterTrigger() would have stored"""
+    session = []
+    cache = deque(maxlen=MAX_TRIGGER_COUNT_IN_CACHE)
+    synced = False
+    receive_timeout_ms = 0
+    for r in records:
+        time_ms = r["timeUs"] // 1000
+        data = r["data"]
+        if r["flags"] & CAPTURE_TX:
+            if r["size"] == 5:
+                synced = True
+            receive_timeout_ms = time_ms + int(time_on_air_ms(r["size"])) + 30
+            continue
+        if r["flags"] & (CAPTURE_CRC_ERROR | CAPTURE_TRUNCATED) or r["size"] <= 1:
+            continue
+        if time_ms <= receive_timeout_ms:
+            print("#%i dropped (own transmission)" % r["seq"])
+            continue
+        if data[0] != network:
+            continue
+        payload = data[1:]
+        if len(payload) % TRIGGER.size != 0 or len(payload) // TRIGGER.size > TRIGGER_BATCH_MAX:
+            continue
+        if not synced:
+            continue
+        triggers = [TRIGGER.unpack_from(payload, i * TRIGGER.size) for i in range(len(payload) // TRIGGER.size)]
+        if any(t[2] > TRIGGER_TYPE_PARCOUR_FINISH for t in triggers):
+            print("#%i station has newer version" % r["seq"])
+            continue
+        for trigger in triggers:
+            variance = trigger[0] - time_ms  # negative for outbox replays
+            if variance >= MAX_TRIGGER_AHEAD_MS or -variance >= MAX_TRIGGER_AGE_MS:
+                print("#%i trigger off by %ims. skipping" % (r["seq"], variance))
+            elif trigger in cache:
+                print("#%i already existing trigger" % r["seq"])
+            else:
+                cache.append(trigger)
+                session.append(trigger)
+                print("#%i trigger at %ims type %i %imm" % (r["seq"], trigger[0], trigger[2], trigger[1]))
+    return session
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Replay a radio capture through the master logic")
+    parser.add_argument("capture")
+    parser.add_argument("-o", "--output", default="replay.rt", help="session file to write")
+    parser.add_argument("--network", type=int, help="1 based network number. Defaults to the network of the captured time syncs")
+    parser.add_argument("--dump", action="store_true", help="print every frame")
+    args = parser.parse_args()
+
+    records = read_capture(args.capture)
+    print("%i records" % len(records))
+    if args.dump:
+        dump(records)
+    network = args.network - 1 if args.network else guess_network(records)
+    if network is None:
+        print("No time sync sent in this capture. Is it from a display? Pass --network")
+        return
+    session = replay_master(records, network)
+    with open(args.output, "wb") as file:
+        for trigger in session:
+            file.write(TRIGGER.pack(*trigger))
+    print("%i triggers written to %s" % (len(session), args.output))
+
+
+if __name__ == "__main__":
+    main()
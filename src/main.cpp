@@ -21,10 +21,12 @@
 #include <WiFiLogic.h>
 #include <Sound.h>
 #include <DoubleLinkedList.h>
+#include <Scheduler.h>
 #include <driver/adc.h>
 #include <heltec.h>
 
 void testMillionTriggers();
+void beginScheduler();
 
 // void handleBattery() {
 //   float voltageDividerMeasured = analogRead(PIN_VBAT) / 4095.0 * 3.3;
@@ -46,6 +48,7 @@ void testMillionTriggers();
 void trigger() {
   triggerCount++;
   lastTriggerMs = millis();
+  wakeSchedulerFromISR(SCHEDULER_EVENT_TRIGGER);
 }
 
 void setup() {
@@ -78,6 +81,7 @@ void setup() {
   // trigger changes
   initStationDisplay();
   beginWiFi();
+  beginScheduler();
 
   pinMode(1, INPUT);
 
@@ -138,29 +142,66 @@ void testMillionTriggers() {
   }
 }
 
-void loop() {
-  /**
-   * normal loop code
-   */
-  handleTriggers();
-  handleRadioReceive();
-  handleRadioSend();
-  handleMasterSlaveLogic();
-  handleRotary();
+void handleUI() {
   uiManager.handle();
-  handleLEDS();
-  // handleBattery();
-  handleSounds();
-  handleStartgun();
-  handleWiFi();
+}
+
+void handleBuzzer() {
   EasyBuzzer.update();
-  loops++;
-  if(millis() - lastHzMeasuredMs > 1000) {
-    loopHz = loops;
+}
+
+void handleLoopStats() {
+  loopHz = loops;
+  if(showAdvancedCB->isChecked()) { // debug menu
     hzText->setValue(loopHz);
-    lastHzMeasuredMs = millis();
-    loops = 0;
+    loopMaxText->setValue(loopMaxUs);
+  }
+  lastHzMeasuredMs = millis();
+  loops = 0;
+  loopMaxUs = 0;
+}
+
+void handleSchedulerReport() {
+  if(showAdvancedCB->isChecked()) {
+    printSchedulerStats(SCHEDULER_REPORT_MS);
+  }
+  resetSchedulerStats();
+}
+
+/**
+ * Priority, period in ms and waking events of every handler. Periods are the longest a handler may wait, not a rate limit,
+ * except for the LEDs. Triggers and radio come first, the buzzer often enough for 10ms beeps
+ */
+void beginScheduler() {
+  addSchedulerTask("triggers", handleTriggers, 0, 100, SCHEDULER_EVENT_TRIGGER);
+  addSchedulerTask("radioRx", handleRadioReceive, 1, 20, SCHEDULER_EVENT_RADIO);
+  addSchedulerTask("radioTx", handleRadioSend, 1, 5);
+  addSchedulerTask("capture", handleRadioCapture, 2, 50, SCHEDULER_EVENT_RADIO);
+  addSchedulerTask("masterSlave", handleMasterSlaveLogic, 2, 10);
+  addSchedulerTask("buzzer", handleBuzzer, 3, 2, SCHEDULER_EVENT_SOUND);
+  addSchedulerTask("sounds", handleSounds, 3, 5, SCHEDULER_EVENT_SOUND);
+  addSchedulerTask("startgun", handleStartgun, 3, 10);
+  addSchedulerTask("rotary", handleRotary, 4, 20, SCHEDULER_EVENT_INPUT);
+  addSchedulerTask("overlay", handleOverlayData, 5, 50);
+  addSchedulerTask("viewer", handleViewer, 5, 100);
+  addSchedulerTask("ui", handleUI, 5, 5, SCHEDULER_EVENT_INPUT);
+  addSchedulerTask("leds", handleLEDS, 6, LED_FRAME_MS);
+  // addSchedulerTask("battery", handleBattery, 7, 1000);
+  addSchedulerTask("wifi", handleWiFi, 7, 10);
+  addSchedulerTask("loopStats", handleLoopStats, 8, 1000);
+  addSchedulerTask("report", handleSchedulerReport, 8, SCHEDULER_REPORT_MS);
+}
+
+void loop() {
+  const uint32_t loopStartUs = micros();
+  if(runDueTasks()) {
+    loops++;
+    const uint32_t loopUs = micros() - loopStartUs;
+    if(loopUs > loopMaxUs) {
+      loopMaxUs = loopUs;
+    }
   }
+  sleepUntilNextTask();
 
   // adc1_config_width(ADC_WIDTH_BIT_12);
   // adc1_config_channel_atten(ADC1_CHANNEL_0,ADC_ATTEN_DB_0);